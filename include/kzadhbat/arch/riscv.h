@@ -40,13 +40,25 @@ _Noreturn inline __attribute__((always_inline)) void wfi(void)
 
 // Generated CSR functions for machine mode registers:
 GENERATE_CSR_FUNCTIONS(mideleg)
+GENERATE_CSR_FUNCTIONS(mcounteren)
 GENERATE_CSR_FUNCTIONS(pmpaddr0)
 GENERATE_CSR_FUNCTIONS(pmpcfg0)
+GENERATE_CSR_FUNCTIONS(menvcfg)
+
+/// Lets the less privileged modes use cbo.zero (Zicboz), menvcfg bit 7.
+#define MENVCFG_CBZE (1ull << 7)
 
 ///////////////////////////////////////////////////////////////////////////////
 // Supervisor mode functions:
 ///////////////////////////////////////////////////////////////////////////////
 
+/// Vector unit state field of sstatus, Off disables vector instructions, Dirty marks registers that need saving.
+#define SSTATUS_VS_MASK (3ull << 9)
+#define SSTATUS_VS_OFF (0ull << 9)
+#define SSTATUS_VS_INITIAL (1ull << 9)
+#define SSTATUS_VS_CLEAN (2ull << 9)
+#define SSTATUS_VS_DIRTY (3ull << 9)
+
 // Generated CSR functions for supervisor mode registers:
 GENERATE_CSR_FUNCTIONS(sstatus)
 GENERATE_CSR_FUNCTIONS(stvec)
@@ -60,6 +72,30 @@ GENERATE_CSR_FUNCTIONS(stval)
 GENERATE_CSR_FUNCTIONS(senvcfg)
 GENERATE_CSR_FUNCTIONS(satp)
 
+/// The kernel keeps the id of the hart it is running on in the tp register, see entry.S.
+static inline __attribute__((always_inline)) u64 cpu_hartid(void)
+{
+	u64 hartid;
+	asm volatile("mv %0, tp" : "=r"(hartid));
+	return hartid;
+}
+
+/// Reads the time counter, which ticks at the timebase-frequency given by the device tree.
+static inline __attribute__((always_inline)) u64 cpu_time(void)
+{
+	u64 time;
+	asm volatile("rdtime %0" : "=r"(time));
+	return time;
+}
+
+/// Reads the cycle counter of the current hart.
+static inline __attribute__((always_inline)) u64 cpu_cycles(void)
+{
+	u64 cycles;
+	asm volatile("rdcycle %0" : "=r"(cycles));
+	return cycles;
+}
+
 // Fences
 static inline __attribute__((always_inline)) void sfence_vma(void)
 {
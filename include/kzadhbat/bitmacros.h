@@ -17,40 +17,97 @@
 /// Flip the endianness of a 16-bit unsigned integer.
 #define ENDIANNESS_FLIP_U16(x) (((x) >> 8) | ((x) << 8))
 
-/// Flip the endianness of a 32-bit unsigned integer.
-#define ENDIANNESS_FLIP_U32(x) ( \
-    (((x) >> 24) & 0x000000FF) | \
-    (((x) >> 8)  & 0x0000FF00) | \
-    (((x) << 8)  & 0x00FF0000) | \
-    (((x) << 24) & 0xFF000000))
+// Byte swaps and bit scans. With Zbb enabled at build time (-DKZADHBAT_ZBB=ON, which defines __riscv_zbb) the
+// builtins compile to single rev8, ctz, clz and cpop instructions. Without it GCC would turn them into calls into
+// libgcc, which the kernel does not link, so the portable versions below are used instead.
 
 /// Flip the endianness of a 64-bit unsigned integer.
-#define ENDIANNESS_FLIP_U64(x) ( \
-	(((x) >> 56) & 0x00000000000000FFULL) | \
-	(((x) >> 40) & 0x000000000000FF00ULL) | \
-	(((x) >> 24) & 0x0000000000FF0000ULL) | \
-	(((x) >> 8)  & 0x00000000FF000000ULL) | \
-	(((x) << 8)  & 0x000000FF00000000ULL) | \
-	(((x) << 24) & 0x0000FF0000000000ULL) | \
-	(((x) << 40) & 0x00FF000000000000ULL) | \
-	(((x) << 56) & 0xFF00000000000000ULL))
+static inline u64 byte_swap_u64(u64 x)
+{
+#ifdef __riscv_zbb
+	return __builtin_bswap64(x);
+#else
+	x = ((x >> 8) & 0x00FF00FF00FF00FFULL) | ((x & 0x00FF00FF00FF00FFULL) << 8);
+	x = ((x >> 16) & 0x0000FFFF0000FFFFULL) | ((x & 0x0000FFFF0000FFFFULL) << 16);
+	return (x >> 32) | (x << 32);
+#endif
+}
 
-/// Flip the endianness of a 128-bit unsigned integer.
-static inline u128 endianness_flip_u128(u128 x)
+/// Flip the endianness of a 32-bit unsigned integer.
+static inline u32 byte_swap_u32(u32 x)
 {
-	union {
-		u128 val;
-		u8 bytes[16];
-	} src, dst;
+#ifdef __riscv_zbb
+	// rev8 reverses all 8 bytes of the register, the 32-bit swap ends up in the upper half
+	return __builtin_bswap64(x) >> 32;
+#else
+	x = ((x >> 8) & 0x00FF00FF) | ((x & 0x00FF00FF) << 8);
+	return (x >> 16) | (x << 16);
+#endif
+}
 
-	src.val = x;
+/// Returns the number of set bits in x.
+static inline u32 bit_popcount(u64 x)
+{
+#ifdef __riscv_zbb
+	return __builtin_popcountll(x);
+#else
+	x = x - ((x >> 1) & 0x5555555555555555ULL);
+	x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+	x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return (x * 0x0101010101010101ULL) >> 56;
+#endif
+}
 
-	// Reverse the byte order
-	for (int i = 0; i < 16; i++) {
-		dst.bytes[i] = src.bytes[15 - i];
-	}
+/// Returns the number of trailing zero bits of x, which must not be 0.
+static inline u32 bit_ctz(u64 x)
+{
+#ifdef __riscv_zbb
+	return __builtin_ctzll(x);
+#else
+	// The bits below the lowest set one
+	return bit_popcount((x & -x) - 1);
+#endif
+}
 
-	return dst.val;
+/// Returns the number of leading zero bits of x, which must not be 0.
+static inline u32 bit_clz(u64 x)
+{
+#ifdef __riscv_zbb
+	return __builtin_clzll(x);
+#else
+	// Smear the highest set bit into every bit below it
+	x |= x >> 1;
+	x |= x >> 2;
+	x |= x >> 4;
+	x |= x >> 8;
+	x |= x >> 16;
+	x |= x >> 32;
+	return 64 - bit_popcount(x);
+#endif
+}
+
+/// Returns the 1-based index of the lowest set bit of x, or 0 if x is 0.
+static inline u32 bit_ffs(u64 x)
+{
+	return x == 0 ? 0 : bit_ctz(x) + 1;
+}
+
+/// Returns the 1-based index of the highest set bit of x, or 0 if x is 0.
+static inline u32 bit_fls(u64 x)
+{
+	return x == 0 ? 0 : 64 - bit_clz(x);
+}
+
+/// Flip the endianness of a 32-bit unsigned integer.
+#define ENDIANNESS_FLIP_U32(x) byte_swap_u32(x)
+
+/// Flip the endianness of a 64-bit unsigned integer.
+#define ENDIANNESS_FLIP_U64(x) byte_swap_u64(x)
+
+/// Flip the endianness of a 128-bit unsigned integer.
+static inline u128 endianness_flip_u128(u128 x)
+{
+	return ((u128)byte_swap_u64((u64)x) << 64) | byte_swap_u64((u64)(x >> 64));
 }
 
 #define ENDIANNESS_FLIP_U128(x) endianness_flip_u128(x)
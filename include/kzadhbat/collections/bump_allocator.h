@@ -1,33 +1,92 @@
- /// Implementation of a bumpAllocator allocator
+/// Implementation of a bumpAllocator allocator
+///
+/// The allocator hands out memory from a chain of chunks by bumping a cursor, new chunks are requested from the refill
+/// callback once the current one runs out. Nothing is freed individually: bump_rewind drops everything allocated
+/// since a bump_mark, bump_release_all hands every chunk back at once.
 #pragma once
 
 #include <kzadhbat/types/numeric_types.h>
 #include <kzadhbat/types/error.h>
+#include <kzadhbat/bitmacros.h>
 
 // Forward Declarations
 struct bumpAllocator;
-struct bumpRegion;
+struct bumpChunk;
 
-/// Creates a new bumpAllocator allocator.
-errval_t bump_init(struct bumpAllocator * allocator, u8* memory, size_t size);
+/// Provides a new chunk of at least min_size bytes, returning it in buf and its length in len.
+typedef errval_t (*bump_refill_func_t)(struct bumpAllocator *bump, size_t min_size, u8 **buf, size_t *len);
+/// Hands a chunk previously provided by the refill callback back.
+typedef void (*bump_release_func_t)(struct bumpAllocator *bump, u8 *buf);
+
+/// Position in the allocator that bump_rewind can return to.
+struct bumpMark {
+	/// The chunk that was current when the mark was taken
+	struct bumpChunk *chunk;
+	/// The cursor inside of that chunk
+	u8 *cursor;
+};
+
+/// Creates a new, empty bumpAllocator allocator that gets its chunks from refill and returns them through release.
+errval_t bump_init(struct bumpAllocator *bump, bump_refill_func_t refill, bump_release_func_t release);
+/// Slow path of bump_alloc_aligned, chains a new chunk and allocates from it.
+void *bump_alloc_chunk(struct bumpAllocator *bump, size_t size, size_t alignment);
+/// Copies a block of memory into the bumpAllocator allocator, returning a pointer to the copied memory.
+/// Returns NULL if the allocation fails, if the source is NULL, or if the size is zero.
+void *bump_copy(struct bumpAllocator *bump, const void *src, size_t size);
+/// Copies a string into the bumpAllocator allocator, returning a pointer to the copied string.
+/// Returns NULL if the allocation fails or if the string is NULL.
+/// This operation is unsafe if the string is not null-terminated.
+const char *bump_copy_string(struct bumpAllocator *bump, const char *src);
+/// Returns the current position of the allocator.
+struct bumpMark bump_mark(struct bumpAllocator *bump);
+/// Frees everything allocated since mark was taken, releasing the chunks chained after it.
+void bump_rewind(struct bumpAllocator *bump, struct bumpMark mark);
+/// Frees everything, releasing every chunk.
+void bump_release_all(struct bumpAllocator *bump);
+/// Returns the number of bytes held by the chunks of the allocator.
+size_t bump_size(struct bumpAllocator *bump);
 
 struct bumpAllocator {
-	/// The base address of the bumpAllocator allocator's memory region.
-	u8 *memory;
-	/// The total size of the bumpAllocator allocator's memory region.
+	/// Next free byte of the current chunk
+	u8 *cursor;
+	/// End of the current chunk
+	u8 *end;
+	/// The current chunk, it links back to the ones before it
+	struct bumpChunk *chunk;
+	/// Total size of the chunks in the chain
+	size_t size;
+	/// Number of chunks in the chain
+	size_t chunks;
+	/// Provides new chunks
+	bump_refill_func_t refill;
+	/// Hands chunks back
+	bump_release_func_t release;
+};
+
+/// Header at the front of every chunk.
+struct bumpChunk {
+	/// The chunk that was current before this one
+	struct bumpChunk *prev;
+	/// Length of the chunk, including this header
 	size_t size;
-	/// The current index of the bumpAllocator allocator.
-	size_t index;
-	/// Allocates a block of memory of size size from the bumpAllocator allocator, return NULL if allocation fails.
-	void* (*alloc)(struct bumpAllocator * alloc, size_t size);
-	/// Copies a block of memory into the bumpAllocator allocator, returning a pointer to the copied memory.
-	/// Returns NULL if the allocation fails, if the source is NULL, or if the size is zero.
-	void* (*copy)(struct bumpAllocator * alloc, const void* src, size_t size);
-	/// Copies a string into the bumpAllocator allocator, returning a pointer to the copied string.
-	/// Returns NULL if the allocation fails or if the string is NULL.
-	/// This operation is unsafe if the string is not null-terminated.
-	const char* (*str_copy)(struct bumpAllocator * alloc, void* src);
-	/// Allocates a block of memory of size size from the bumpAllocator allocator, ensuring that the allocated memory is
-	/// aligned to the specified alignment.
-	void* (*alloc_aligned)(struct bumpAllocator * alloc, size_t size, size_t alignment);
-};
\ No newline at end of file
+};
+
+/// Allocates a block of memory of size size from the bumpAllocator allocator, ensuring that the allocated memory is
+/// aligned to the specified power of two alignment. Returns NULL if the size is zero or the allocation fails.
+static inline __attribute__((always_inline)) void *bump_alloc_aligned(struct bumpAllocator *bump, size_t size,
+								     size_t alignment)
+{
+	uintptr_t ptr = ALIGN_UP((uintptr_t)bump->cursor, alignment);
+	// Compare lengths rather than pointers, so huge sizes cannot wrap around
+	if (ptr <= (uintptr_t)bump->end && size <= (uintptr_t)bump->end - ptr && size != 0) {
+		bump->cursor = (u8 *)(ptr + size);
+		return (void *)ptr;
+	}
+	return size == 0 ? NULL : bump_alloc_chunk(bump, size, alignment);
+}
+
+/// Allocates a block of memory of size size from the bumpAllocator allocator, return NULL if allocation fails.
+static inline __attribute__((always_inline)) void *bump_alloc(struct bumpAllocator *bump, size_t size)
+{
+	return bump_alloc_aligned(bump, size, 1);
+}
@@ -0,0 +1,353 @@
+/// Defines a macro programmed open addressing HashMap<K, V> type and the functions operating on it.
+///
+/// The map uses Robin Hood hashing: an entry's probe distance (how far it sits from its home bucket) is kept in a
+/// separate byte array, inserts displace entries that are closer to home than the one being inserted, lookups stop
+/// as soon as they pass an entry closer to home than the key could be, and removals shift the following entries
+/// back instead of leaving tombstones. Home buckets are picked by multiplying the hash with 2^64 / phi and keeping
+/// the top bits, so weak hash functions (like the identity on integers) still spread.
+///
+/// Growing is incremental: a full map allocates a table twice the size and every following insert or remove moves a
+/// few entries of the old table over, so no single operation pays for the whole rehash. Lookups check both tables
+/// while a resize is in progress. Storage comes from the alloc and free callbacks handed to init, which may be
+/// kmalloc or a bumpAllocator (with a free callback that does nothing).
+///
+/// K and V must be single identifiers, typedef pointer and struct types first (the same limitation as ARRAY).
+#pragma once
+
+#include <kzadhbat/types/numeric_types.h>
+#include <kzadhbat/types/error.h>
+#include <kzadhbat/libc/string.h>
+#include <kzadhbat/assert.h>
+#include <kzadhbat/bitmacros.h>
+
+/// Allocates size bytes of table storage, returning NULL when out of memory.
+typedef void *(*hashmap_alloc_func_t)(void *ctx, size_t size);
+/// Frees table storage handed out by the matching hashmap_alloc_func_t.
+typedef void (*hashmap_free_func_t)(void *ctx, void *ptr);
+
+/// Number of buckets of the smallest table.
+#define HASHMAP_MIN_CAPACITY 8
+/// Buckets of the old table moved over by every insert and remove during a resize. A resize is done after
+/// capacity / HASHMAP_MIGRATE_STEP inserts, long before the table twice the size fills up.
+#define HASHMAP_MIGRATE_STEP 8
+/// Probe distances are stored in a byte, 0 marks an empty bucket. Inserts that would go further grow the table.
+#define HASHMAP_MAX_DISTANCE 255
+
+/// The HashMap<K, V> type
+#define HASHMAP(k, v) HASHMAP_STR(k, v)
+#define HASHMAP_STR(k, v) HashMap_##k##_##v
+/// The table type backing a HashMap<K, V>
+#define HASHMAP_TABLE(k, v) HASHMAP_TABLE_STR(k, v)
+#define HASHMAP_TABLE_STR(k, v) HashMapTable_##k##_##v
+/// The entry type of a HashMap<K, V>
+#define HASHMAP_ENTRY(k, v) HASHMAP_ENTRY_STR(k, v)
+#define HASHMAP_ENTRY_STR(k, v) HashMapEntry_##k##_##v
+/// Names the function op of a HashMap<K, V>, e.g. HASHMAP_FN(u32, u64, get)(&map, key).
+#define HASHMAP_FN(k, v, op) HASHMAP_FN_STR(k, v, op)
+#define HASHMAP_FN_STR(k, v, op) hashmap_##k##_##v##_##op
+
+/// Maps a hash to one of the 2^(64 - shift) buckets of a table.
+#define HASHMAP_BUCKET(hash, shift) ((size_t)(((u64)(hash) * 0x9E3779B97F4A7C15ull) >> (shift)))
+
+/// Declares and defines a HashMap<K, V> type hashing keys with hash(K) -> u64 and comparing them with eq(K, K) ->
+/// bool, along with the following functions:
+///
+///  * errval_t init(map, capacity, alloc, free, ctx): creates a map sized for capacity entries.
+///  * errval_t insert(map, key, value): adds or replaces the value of key. A failed insert leaves the map as it was.
+///  * V *get(map, key): returns the value of key, or NULL. The pointer is invalidated by the next insert or remove.
+///  * bool remove(map, key): removes key, returning false if it was not in the map.
+///  * size_t count(map): returns the number of entries.
+///  * void destroy(map): frees the tables of the map.
+#define DEFINE_HASHMAP(K, V, hash, eq)                                                                                \
+	typedef struct {                                                                                              \
+		K key;                                                                                                \
+		V value;                                                                                              \
+	} HASHMAP_ENTRY(K, V);                                                                                        \
+                                                                                                                      \
+	typedef struct {                                                                                              \
+		/* Probe distance + 1 of the entry in every bucket, 0 if the bucket is empty */                       \
+		u8 *distances;                                                                                        \
+		HASHMAP_ENTRY(K, V) *entries;                                                                         \
+		size_t capacity;                                                                                      \
+		size_t count;                                                                                         \
+		/* 64 - log2(capacity) */                                                                             \
+		u32 shift;                                                                                            \
+	} HASHMAP_TABLE(K, V);                                                                                        \
+                                                                                                                      \
+	typedef struct {                                                                                              \
+		/* The table inserts go to */                                                                         \
+		HASHMAP_TABLE(K, V) table;                                                                            \
+		/* The table being migrated from, its capacity is 0 if no resize is in progress */                    \
+		HASHMAP_TABLE(K, V) old;                                                                              \
+		/* Next bucket of the old table to migrate */                                                         \
+		size_t migrate;                                                                                       \
+		hashmap_alloc_func_t alloc;                                                                           \
+		hashmap_free_func_t free;                                                                             \
+		void *ctx;                                                                                            \
+	} HASHMAP(K, V);                                                                                              \
+                                                                                                                      \
+	static inline __attribute__((unused)) errval_t HASHMAP_FN(K, V, table_init)(HASHMAP(K, V) * map,             \
+										    HASHMAP_TABLE(K, V) * table, \
+										    size_t capacity)             \
+	{                                                                                                             \
+		size_t distances = (capacity + sizeof(HASHMAP_ENTRY(K, V)) - 1) / sizeof(HASHMAP_ENTRY(K, V)) *       \
+				   sizeof(HASHMAP_ENTRY(K, V));                                                       \
+		u8 *storage = map->alloc(map->ctx, distances + capacity * sizeof(HASHMAP_ENTRY(K, V)));               \
+		if (storage == NULL) {                                                                                \
+			return ERR_HASHMAP_OUT_OF_MEMORY;                                                             \
+		}                                                                                                     \
+		memset(storage, 0, capacity);                                                                         \
+		table->distances = storage;                                                                           \
+		table->entries = (HASHMAP_ENTRY(K, V) *)(storage + distances);                                        \
+		table->capacity = capacity;                                                                           \
+		table->count = 0;                                                                                     \
+		table->shift = 64 - bit_ctz(capacity);                                                                \
+		return ERR_OK;                                                                                        \
+	}                                                                                                             \
+                                                                                                                      \
+	static inline __attribute__((unused)) errval_t HASHMAP_FN(K, V, init)(                                       \
+		HASHMAP(K, V) * map, size_t capacity, hashmap_alloc_func_t alloc, hashmap_free_func_t free, void *ctx) \
+	{                                                                                                             \
+		if (map == NULL || alloc == NULL) {                                                                   \
+			return ERR_NULL_ARGUMENT;                                                                     \
+		}                                                                                                     \
+		map->alloc = alloc;                                                                                   \
+		map->free = free;                                                                                     \
+		map->ctx = ctx;                                                                                       \
+		map->old = (HASHMAP_TABLE(K, V)){ 0 };                                                                \
+		map->migrate = 0;                                                                                     \
+		/* Keep the load factor at or below 7/8 */                                                            \
+		size_t buckets = HASHMAP_MIN_CAPACITY;                                                                \
+		while (buckets - buckets / 8 < capacity) {                                                            \
+			buckets *= 2;                                                                                 \
+		}                                                                                                     \
+		return HASHMAP_FN(K, V, table_init)(map, &map->table, buckets);                                       \
+	}                                                                                                             \
+                                                                                                                      \
+	/* Returns the bucket holding key in table, or table->capacity if it is not there */                         \
+	static inline __attribute__((unused)) size_t HASHMAP_FN(K, V, table_find)(HASHMAP_TABLE(K, V) * table, K key, \
+										  u64 h)                          \
+	{                                                                                                             \
+		if (table->count == 0) {                                                                              \
+			return table->capacity;                                                                       \
+		}                                                                                                     \
+		size_t mask = table->capacity - 1;                                                                    \
+		size_t i = HASHMAP_BUCKET(h, table->shift);                                                           \
+		for (u32 distance = 1;; distance++, i = (i + 1) & mask) {                                             \
+			/* An entry closer to its home than key would be means key is not in the table */             \
+			if (table->distances[i] < distance) {                                                         \
+				return table->capacity;                                                               \
+			}                                                                                             \
+			if (table->distances[i] == distance && eq(table->entries[i].key, key)) {                      \
+				return i;                                                                             \
+			}                                                                                             \
+		}                                                                                                     \
+	}                                                                                                             \
+                                                                                                                      \
+	/* Returns whether table_put can put an entry with hash h into table without a probe getting longer than      \
+	   HASHMAP_MAX_DISTANCE. Walks the same buckets table_put would, without robbing anything */                  \
+	static inline __attribute__((unused)) bool HASHMAP_FN(K, V, table_fits)(HASHMAP_TABLE(K, V) * table, u64 h)   \
+	{                                                                                                             \
+		size_t mask = table->capacity - 1;                                                                    \
+		size_t i = HASHMAP_BUCKET(h, table->shift);                                                           \
+		for (u32 distance = 1; distance <= HASHMAP_MAX_DISTANCE; distance++, i = (i + 1) & mask) {            \
+			if (table->distances[i] == 0) {                                                               \
+				return true;                                                                          \
+			}                                                                                             \
+			/* table_put robs this entry and carries it on from here */                                   \
+			if (table->distances[i] < distance) {                                                         \
+				distance = table->distances[i];                                                       \
+			}                                                                                             \
+		}                                                                                                     \
+		return false;                                                                                         \
+	}                                                                                                             \
+                                                                                                                      \
+	/* Puts an entry whose key is not in table into it, table_fits must have said that it fits */                 \
+	static inline __attribute__((unused)) void HASHMAP_FN(K, V, table_put)(HASHMAP_TABLE(K, V) * table,           \
+									       HASHMAP_ENTRY(K, V) entry, u64 h)      \
+	{                                                                                                             \
+		size_t mask = table->capacity - 1;                                                                    \
+		size_t i = HASHMAP_BUCKET(h, table->shift);                                                           \
+		for (u32 distance = 1;; distance++, i = (i + 1) & mask) {                                             \
+			if (table->distances[i] == 0) {                                                               \
+				table->distances[i] = distance;                                                       \
+				table->entries[i] = entry;                                                            \
+				table->count++;                                                                       \
+				return;                                                                               \
+			}                                                                                             \
+			/* Rob the entry that is closer to its home, and carry it on */                               \
+			if (table->distances[i] < distance) {                                                         \
+				HASHMAP_ENTRY(K, V) robbed = table->entries[i];                                       \
+				u32 robbed_distance = table->distances[i];                                            \
+				table->entries[i] = entry;                                                            \
+				table->distances[i] = distance;                                                       \
+				entry = robbed;                                                                       \
+				distance = robbed_distance;                                                           \
+			}                                                                                             \
+		}                                                                                                     \
+	}                                                                                                             \
+                                                                                                                      \
+	/* Empties bucket i, shifting the entries after it back towards their homes */                                \
+	static inline __attribute__((unused)) void HASHMAP_FN(K, V, table_erase)(HASHMAP_TABLE(K, V) * table,         \
+										 size_t i)                            \
+	{                                                                                                             \
+		size_t mask = table->capacity - 1;                                                                    \
+		size_t next = (i + 1) & mask;                                                                         \
+		while (table->distances[next] > 1) {                                                                  \
+			table->entries[i] = table->entries[next];                                                     \
+			table->distances[i] = table->distances[next] - 1;                                             \
+			i = next;                                                                                     \
+			next = (next + 1) & mask;                                                                     \
+		}                                                                                                     \
+		table->distances[i] = 0;                                                                              \
+		table->count--;                                                                                       \
+	}                                                                                                             \
+                                                                                                                      \
+	/* Moves up to HASHMAP_MIGRATE_STEP buckets of the old table over, freeing it once it is empty. Fails if an   \
+	   entry does not fit into the new table, leaving it in the old one where lookups still find it */            \
+	static inline __attribute__((unused)) errval_t HASHMAP_FN(K, V, migrate)(HASHMAP(K, V) * map)                 \
+	{                                                                                                             \
+		HASHMAP_TABLE(K, V) *old = &map->old;                                                                 \
+		for (size_t step = 0; step < HASHMAP_MIGRATE_STEP && map->migrate < old->capacity; step++) {          \
+			size_t i = map->migrate;                                                                      \
+			if (old->distances[i] == 0) {                                                                 \
+				map->migrate++;                                                                       \
+				continue;                                                                             \
+			}                                                                                             \
+			HASHMAP_ENTRY(K, V) entry = old->entries[i];                                                  \
+			u64 h = hash(entry.key);                                                                      \
+			if (!HASHMAP_FN(K, V, table_fits)(&map->table, h)) {                                          \
+				return ERR_HASHMAP_PROBE_TOO_LONG;                                                    \
+			}                                                                                             \
+			/* Erasing shifts the next entry into bucket i, so the cursor stays */                        \
+			HASHMAP_FN(K, V, table_erase)(old, i);                                                        \
+			HASHMAP_FN(K, V, table_put)(&map->table, entry, h);                                           \
+		}                                                                                                     \
+		if (old->capacity != 0 && (old->count == 0 || map->migrate == old->capacity)) {                       \
+			if (map->free != NULL) {                                                                      \
+				map->free(map->ctx, old->distances);                                                  \
+			}                                                                                             \
+			*old = (HASHMAP_TABLE(K, V)){ 0 };                                                            \
+			map->migrate = 0;                                                                             \
+		}                                                                                                     \
+		return ERR_OK;                                                                                        \
+	}                                                                                                             \
+                                                                                                                      \
+	/* Starts moving the entries into a table twice the size */                                                   \
+	static inline __attribute__((unused)) errval_t HASHMAP_FN(K, V, grow)(HASHMAP(K, V) * map)                   \
+	{                                                                                                             \
+		/* A resize still in progress has to finish first, there is only room for one old table */            \
+		while (map->old.capacity != 0) {                                                                      \
+			errval_t err = HASHMAP_FN(K, V, migrate)(map);                                                \
+			if (err_is_fail(err)) {                                                                       \
+				return err;                                                                           \
+			}                                                                                             \
+		}                                                                                                     \
+		HASHMAP_TABLE(K, V) table;                                                                            \
+		errval_t err = HASHMAP_FN(K, V, table_init)(map, &table, map->table.capacity * 2);                    \
+		if (err_is_fail(err)) {                                                                               \
+			return err;                                                                                   \
+		}                                                                                                     \
+		map->old = map->table;                                                                                \
+		map->table = table;                                                                                   \
+		map->migrate = 0;                                                                                     \
+		return ERR_OK;                                                                                        \
+	}                                                                                                             \
+                                                                                                                      \
+	static inline __attribute__((unused)) errval_t HASHMAP_FN(K, V, insert)(HASHMAP(K, V) * map, K key, V value) \
+	{                                                                                                             \
+		u64 h = hash(key);                                                                                    \
+		size_t i = HASHMAP_FN(K, V, table_find)(&map->table, key, h);                                         \
+		if (i != map->table.capacity) {                                                                       \
+			map->table.entries[i].value = value;                                                          \
+			return ERR_OK;                                                                                \
+		}                                                                                                     \
+		i = HASHMAP_FN(K, V, table_find)(&map->old, key, h);                                                  \
+		if (i != map->old.capacity) {                                                                         \
+			map->old.entries[i].value = value;                                                            \
+			return ERR_OK;                                                                                \
+		}                                                                                                     \
+                                                                                                                      \
+		if (map->table.count + 1 > map->table.capacity - map->table.capacity / 8) {                           \
+			errval_t err = HASHMAP_FN(K, V, grow)(map);                                                   \
+			if (err_is_fail(err)) {                                                                       \
+				return err;                                                                           \
+			}                                                                                             \
+		}                                                                                                     \
+		/* A stuck migration leaves its entries in the old table, inserts go on until the next grow */        \
+		(void)HASHMAP_FN(K, V, migrate)(map);                                                                 \
+		/* Grow before putting the entry in, table_put must not rob entries it cannot place again */          \
+		while (!HASHMAP_FN(K, V, table_fits)(&map->table, h)) {                                               \
+			errval_t err = HASHMAP_FN(K, V, grow)(map);                                                   \
+			if (err_is_fail(err)) {                                                                       \
+				return err;                                                                           \
+			}                                                                                             \
+		}                                                                                                     \
+		HASHMAP_FN(K, V, table_put)(&map->table, (HASHMAP_ENTRY(K, V)){ .key = key, .value = value }, h);     \
+		return ERR_OK;                                                                                        \
+	}                                                                                                             \
+                                                                                                                      \
+	static inline __attribute__((unused)) V *HASHMAP_FN(K, V, get)(HASHMAP(K, V) * map, K key)                   \
+	{                                                                                                             \
+		u64 h = hash(key);                                                                                    \
+		size_t i = HASHMAP_FN(K, V, table_find)(&map->table, key, h);                                         \
+		if (i != map->table.capacity) {                                                                       \
+			return &map->table.entries[i].value;                                                          \
+		}                                                                                                     \
+		i = HASHMAP_FN(K, V, table_find)(&map->old, key, h);                                                  \
+		return i != map->old.capacity ? &map->old.entries[i].value : NULL;                                    \
+	}                                                                                                             \
+                                                                                                                      \
+	static inline __attribute__((unused)) bool HASHMAP_FN(K, V, remove)(HASHMAP(K, V) * map, K key)              \
+	{                                                                                                             \
+		u64 h = hash(key);                                                                                    \
+		bool removed = false;                                                                                 \
+		size_t i = HASHMAP_FN(K, V, table_find)(&map->table, key, h);                                         \
+		if (i != map->table.capacity) {                                                                       \
+			HASHMAP_FN(K, V, table_erase)(&map->table, i);                                                \
+			removed = true;                                                                               \
+		} else if ((i = HASHMAP_FN(K, V, table_find)(&map->old, key, h)) != map->old.capacity) {              \
+			HASHMAP_FN(K, V, table_erase)(&map->old, i);                                                  \
+			removed = true;                                                                               \
+		}                                                                                                     \
+		(void)HASHMAP_FN(K, V, migrate)(map);                                                                 \
+		return removed;                                                                                       \
+	}                                                                                                             \
+                                                                                                                      \
+	static inline __attribute__((unused)) size_t HASHMAP_FN(K, V, count)(HASHMAP(K, V) * map)                    \
+	{                                                                                                             \
+		return map->table.count + map->old.count;                                                             \
+	}                                                                                                             \
+                                                                                                                      \
+	static inline __attribute__((unused)) void HASHMAP_FN(K, V, destroy)(HASHMAP(K, V) * map)                    \
+	{                                                                                                             \
+		if (map->free != NULL) {                                                                              \
+			map->free(map->ctx, map->table.distances);                                                    \
+			if (map->old.capacity != 0) {                                                                 \
+				map->free(map->ctx, map->old.distances);                                              \
+			}                                                                                             \
+		}                                                                                                     \
+		map->table = (HASHMAP_TABLE(K, V)){ 0 };                                                              \
+		map->old = (HASHMAP_TABLE(K, V)){ 0 };                                                                \
+	}
+
+/// Hashes an integer key, HASHMAP_BUCKET does the mixing.
+static inline __attribute__((unused)) u64 hash_u64(u64 key)
+{
+	return key;
+}
+
+/// Hashes a NUL terminated string with FNV-1a.
+static inline __attribute__((unused)) u64 hash_str(const char *key)
+{
+	u64 h = 0xCBF29CE484222325ull;
+	for (; *key != '\0'; key++) {
+		h = (h ^ (u8)*key) * 0x100000001B3ull;
+	}
+	return h;
+}
+
+/// Compares integer keys.
+#define HASHMAP_EQ(a, b) ((a) == (b))
+/// Compares string keys.
+#define HASHMAP_STR_EQ(a, b) (strcmp((a), (b)) == 0)
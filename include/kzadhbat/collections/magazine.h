@@ -0,0 +1,91 @@
+// A per-hart magazine cache
+//
+// Largely inspired by Bonwick and Adams' "Magazines and Vmem" paper. Every hart owns two magazines (stacks of cached
+// objects) that it allocates from and frees into without taking any lock. Only when both are exhausted (or full)
+// does the hart exchange a magazine with the shared depot, and only when the depot can't help are objects moved to
+// or from the backing allocator, in batches of half a magazine.
+#pragma once
+
+#include <kzadhbat/types/numeric_types.h>
+#include <kzadhbat/types/error.h>
+#include <kzadhbat/sync/spinlock.h>
+
+/// Number of objects a single magazine can hold.
+#define MAGAZINE_ROUNDS 16
+/// Number of harts with their own magazines, harts beyond this go straight to the backing allocator.
+#define MAGAZINE_MAX_HARTS 8
+/// Number of magazines every hart keeps loaded.
+#define MAGAZINE_PER_HART 2
+
+// forward declarations
+struct magazine;
+struct magazineCache;
+
+/// Pulls up to count objects out of the backing allocator, returning how many were handed out.
+typedef size_t (*magazine_fill_func_t)(void *ctx, void **objects, size_t count);
+/// Returns count objects to the backing allocator.
+typedef void (*magazine_drain_func_t)(void *ctx, void **objects, size_t count);
+
+/// Initializes the cache, handing it the magazines it may use. At least MAGAZINE_PER_HART * MAGAZINE_MAX_HARTS
+/// magazines must be provided, the rest are kept in the depot.
+errval_t magazine_init(struct magazineCache *cache, const char *name, struct magazine *magazines, size_t count,
+		       magazine_fill_func_t fill, magazine_drain_func_t drain, void *ctx);
+/// Allocates an object from the current hart's magazines, falling back to the depot and the backing allocator.
+void *magazine_alloc(struct magazineCache *cache);
+/// Frees an object into the current hart's magazines, falling back to the depot and the backing allocator.
+void magazine_free(struct magazineCache *cache, void *object);
+/// Returns the objects cached in the depot and in the current hart's magazines to the backing allocator.
+size_t magazine_reclaim(struct magazineCache *cache);
+/// Returns the number of objects currently cached, an estimate as other harts keep running.
+size_t magazine_cached(struct magazineCache *cache);
+/// Prints the hit rates and depot traffic of the cache.
+void magazine_print_stats(struct magazineCache *cache);
+
+struct magazine {
+	/// Next magazine in the depot list.
+	struct magazine *next;
+	/// Number of objects held by the magazine.
+	size_t rounds;
+	/// The cached objects, used as a stack.
+	void *objects[MAGAZINE_ROUNDS];
+};
+
+struct magazineHart {
+	/// Magazine allocations and frees are served from.
+	struct magazine *loaded;
+	/// Previously loaded magazine, swapped with loaded when that one runs empty or full.
+	struct magazine *previous;
+	/// Allocations served without touching the depot.
+	u64 alloc_hits;
+	/// Allocations that had to go to the depot or the backing allocator.
+	u64 alloc_misses;
+	/// Frees absorbed without touching the depot.
+	u64 free_hits;
+	/// Frees that had to go to the depot or the backing allocator.
+	u64 free_misses;
+} __attribute__((aligned(64)));
+
+struct magazineCache {
+	/// Name of the cache, used for reporting.
+	const char *name;
+	/// Per hart magazines, only ever touched by their own hart.
+	struct magazineHart harts[MAGAZINE_MAX_HARTS];
+	/// Protects the depot lists and counters below.
+	struct spinlock depot_lock;
+	/// Depot list of full magazines.
+	struct magazine *full;
+	/// Depot list of empty magazines.
+	struct magazine *empty;
+	/// Full magazines handed from the depot to a hart.
+	u64 depot_gets;
+	/// Full magazines handed from a hart to the depot.
+	u64 depot_puts;
+	/// Batches pulled from the backing allocator.
+	u64 backend_fills;
+	/// Batches returned to the backing allocator.
+	u64 backend_drains;
+	/// Backing allocator.
+	magazine_fill_func_t fill;
+	magazine_drain_func_t drain;
+	void *ctx;
+};
@@ -10,12 +10,28 @@
 struct slabAllocator;
 struct slabRegion;
 
-/// If defined, the slab allocator will zero out the memory of allocated blocks.
-#define ZERO_OUT_SLAB_BLOCKS
+// If ZERO_OUT_SLAB_BLOCKS is defined (see the KZADHBAT_ZERO_SLAB_BLOCKS cmake option), the slab allocator zeroes out
+// the memory of allocated blocks. Users that initialize their blocks anyway are better served by a slabCache with a
+// constructor, which keeps freed objects constructed.
+
+/// Grows the allocator (usually with slab_grow) when it runs low on free blocks.
+typedef errval_t (*slab_refill_func_t)(struct slabAllocator *slabs);
+
+/// Hands an empty SLAB_REGION_ALIGN sized region back to wherever the allocator got it from.
+typedef errval_t (*slab_release_func_t)(struct slabAllocator *slabs, void *buf);
 
 /// Creates a new allocator with the given block size.
 errval_t slab_init(struct slabAllocator *slabs, size_t blocksize);
-/// Adds the buf region (with length len) to the allocator.
+/// Makes the allocator call refill whenever an allocation finds at most watermark free blocks. The blocks below the
+/// watermark stay available to the allocations made by refill itself, which is never reentered.
+errval_t slab_set_refill(struct slabAllocator *slabs, slab_refill_func_t refill, size_t watermark);
+/// Gives up blocks in every new region until the slack leaves room for colors cache line offsets. By default regions
+/// are only colored within the slack left over by the block size.
+errval_t slab_set_colors(struct slabAllocator *slabs, size_t colors);
+/// Makes slab_reclaim hand empty regions back with release.
+errval_t slab_set_release(struct slabAllocator *slabs, slab_release_func_t release);
+/// Adds the buf region (with length len) to the allocator. The buffer is split into slab regions at every
+/// SLAB_REGION_ALIGN boundary inside of it, the unaligned head and tail are left unused.
 errval_t slab_grow(struct slabAllocator *slabs, void *buf, size_t len);
 /// Allocate a block from the allocator.
 void *slab_alloc(struct slabAllocator *slabs);
@@ -23,32 +39,66 @@ void *slab_alloc(struct slabAllocator *slabs);
 errval_t slab_free(struct slabAllocator *slabs, void *block);
 /// The free count of blocks managed by the allocator.
 size_t slab_freecount(struct slabAllocator *slabs);
+/// Releases empty regions while more than the watermark's worth of free blocks is left, returning how many were
+/// released. Meant for memory pressure.
+size_t slab_reclaim(struct slabAllocator *slabs);
 
+// Slab regions are SLAB_REGION_ALIGN bytes long and aligned to it, so a block finds its region by masking its address
+#define SLAB_REGION_ALIGN 4096
+// Granularity of the offsets new regions are colored with, one cache line
+#define SLAB_COLOR_ALIGN 64
+// Marks the header of a slab region, cross-checked by slab_free
+#define SLAB_REGION_MAGIC 0x51AB51AB51AB51ABull
 // Size of block header
 #define SLAB_HEADER_SIZE (sizeof(void *))
 // The size of a block must be at least as big as the header size
 #define SLAB_BLOCKSIZE(blocksize) (((blocksize) > SLAB_HEADER_SIZE) ? (blocksize) : SLAB_HEADER_SIZE)
-// Macro to compute the static buffer size required to fit a Slab Region with n elements
-#define SLAB_REGION_SIZE(n, blocksize) ((n) * SLAB_BLOCKSIZE(blocksize) + sizeof(struct slabRegion))
+// Number of blocks held by a single slab region, unless slab_set_colors gave some of them up
+#define SLAB_REGION_BLOCKS(blocksize) ((SLAB_REGION_ALIGN - sizeof(struct slabRegion)) / SLAB_BLOCKSIZE(blocksize))
 
 struct slabAllocator {
 	/// Size of blocks managed by this allocator
 	size_t blocksize;
-	/// Pointer to a list of slab regions
-	struct slabRegion *regions;
+	/// Regions with both free and allocated blocks, allocations are served from the head
+	struct slabRegion *partial;
+	/// Regions without any free block
+	struct slabRegion *full;
+	/// Regions without any allocated block, used once no partial region is left
+	struct slabRegion *empty;
 	/// Count of total blocks managed by this allocator
 	u64 total;
 	/// Count of free blocks managed by this allocator
 	u64 free;
+	/// Called to grow the allocator once free drops to the watermark, NULL if the allocator is grown by hand
+	slab_refill_func_t refill;
+	/// Number of free blocks kept in reserve for the refill function
+	size_t watermark;
+	/// Set while the refill function runs, so allocations made by it don't refill again
+	bool refilling;
+	/// Called by slab_reclaim to hand back empty regions, NULL if they are kept
+	slab_release_func_t release;
+	/// Blocks laid out in every new region
+	size_t region_blocks;
+	/// Offset of the first block of the next region past its header, rotating through the slack of a region
+	size_t color;
+	/// Largest color that still fits the slack of a region
+	size_t max_color;
 };
 
 struct slabRegion {
-	/// Next slabRegion in the slabAllocator list.
+	/// SLAB_REGION_MAGIC while the region belongs to an allocator.
+	u64 magic;
+	/// The allocator the region belongs to.
+	struct slabAllocator *slabs;
+	/// Next and previous slabRegion in the partial, full or empty list of the allocator.
 	struct slabRegion *next;
+	struct slabRegion *prev;
 	/// Count of total blocks in this Region
 	u64 total;
 	/// Count of free blocks in this Region
 	u64 free;
+	/// Offset of the first block past the header, spreads the blocks of different regions across cache sets
+	u64 color;
 	/// Free list of blocks in this Region
 	struct slabBlock *blocks;
 };
@@ -0,0 +1,58 @@
+// A named object cache shared between harts
+//
+// Puts a per-hart magazine cache (see magazine.h) in front of a slabAllocator. Allocations and frees are served from
+// the current hart's magazines without taking any shared lock, the slabAllocator itself is only touched, under its
+// lock, when the depot has to be refilled or drained.
+//
+// Following Bonwick, objects are kept in their constructed state: the constructor runs when an object leaves the
+// slabAllocator and the destructor when it goes back, never on the magazine fast path. Freed objects must therefore
+// be returned constructed, and nothing is zeroed on the way out.
+#pragma once
+
+#include <kzadhbat/types/numeric_types.h>
+#include <kzadhbat/types/error.h>
+#include <kzadhbat/collections/slab.h>
+#include <kzadhbat/collections/magazine.h>
+#include <kzadhbat/sync/spinlock.h>
+
+/// Magazines needed by a slabCache, two per hart plus a few parked in the depot.
+#define SLAB_CACHE_MAGAZINE_COUNT (MAGAZINE_PER_HART * MAGAZINE_MAX_HARTS + 8)
+
+// forward declarations
+struct slabCache;
+
+/// Brings an object into (or out of) its constructed state.
+typedef void (*slab_object_func_t)(void *object);
+
+/// Creates a cache of blocksize sized objects, handing it the magazines it may use (see magazine_init). ctor and dtor
+/// may be NULL, objects are then handed out exactly as they were freed. The slab allocator starts out empty, grow it
+/// with slab_cache_grow or give it a refill function through slab_cache_slabs.
+errval_t slab_cache_init(struct slabCache *cache, const char *name, size_t blocksize, slab_object_func_t ctor,
+			 slab_object_func_t dtor, struct magazine *magazines, size_t count);
+/// Adds the buf region (with length len) to the slab allocator of the cache.
+errval_t slab_cache_grow(struct slabCache *cache, void *buf, size_t len);
+/// Allocates a constructed object from the current hart's magazines.
+void *slab_cache_alloc(struct slabCache *cache);
+/// Frees a constructed object into the current hart's magazines.
+errval_t slab_cache_free(struct slabCache *cache, void *block);
+/// Returns the blocks cached in the depot and the current hart's magazines to the slab allocator, then releases its
+/// empty regions (see slab_reclaim). Returns the number of blocks moved back.
+size_t slab_cache_reclaim(struct slabCache *cache);
+/// Returns the slab allocator behind the cache, to set its refill and release functions.
+struct slabAllocator *slab_cache_slabs(struct slabCache *cache);
+/// Prints the magazine hit ratios of the cache and the occupancy of its slab allocator.
+void slab_cache_print_stats(struct slabCache *cache);
+
+struct slabCache {
+	/// Name of the cache, used for reporting.
+	const char *name;
+	/// Backing slab allocator, only touched with lock held.
+	struct slabAllocator slabs;
+	/// Protects slabs.
+	struct spinlock lock;
+	/// Run on objects leaving and entering slabs, NULL if the objects need no construction.
+	slab_object_func_t ctor;
+	slab_object_func_t dtor;
+	/// Per hart magazines in front of slabs.
+	struct magazineCache magazines;
+};
@@ -6,13 +6,21 @@
 #define NULL 0
 #endif
 
+/// Switches memcpy, memset, memcmp, strlen, strcmp and strncmp over to their RVV implementations (see the
+/// KZADHBAT_RVV cmake option), or back to the scalar ones. The caller must have turned the vector unit on.
+void libc_use_vector(bool enable);
+
 // String Manipulation
 
 // String Examination
 size_t strlen(const char *str);
+size_t strnlen(const char *str, size_t max);
 int strcmp(const char *lhs, const char *rhs);
 int strncmp(const char *lhs, const char *rhs, size_t num);
 
 // Character Array Manipulation
+void *memchr(const void *ptr, int ch, size_t count);
 void *memset(void *dest, int ch, size_t count);
-void *memcpy(void *dest, const void *src, size_t count);
\ No newline at end of file
+void *memcpy(void *dest, const void *src, size_t count);
+void *memmove(void *dest, const void *src, size_t count);
+int memcmp(const void *lhs, const void *rhs, size_t count);
\ No newline at end of file
@@ -0,0 +1,31 @@
+/// A test-and-test-and-set spinlock.
+#pragma once
+
+#include <kzadhbat/types/numeric_types.h>
+
+struct spinlock {
+	/// Non-zero while the lock is held.
+	volatile u32 locked;
+};
+
+/// Static initializer for an unlocked spinlock.
+#define SPINLOCK_INIT { .locked = 0 }
+
+static inline void spinlock_init(struct spinlock *lock)
+{
+	__atomic_store_n(&lock->locked, 0, __ATOMIC_RELAXED);
+}
+
+static inline void spinlock_acquire(struct spinlock *lock)
+{
+	while (__atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE) != 0) {
+		// Spin on a plain load so waiting harts don't keep stealing the cache line
+		while (__atomic_load_n(&lock->locked, __ATOMIC_RELAXED) != 0) {
+		}
+	}
+}
+
+static inline void spinlock_release(struct spinlock *lock)
+{
+	__atomic_store_n(&lock->locked, 0, __ATOMIC_RELEASE);
+}
@@ -15,6 +15,11 @@ enum grouperError {
 	// Slab allocator errors:
 	ERR_SLAB_REGION_TOO_SMALL,
 	ERR_SLAB_FOREIGN_BLOCK,
+	// Magazine cache errors:
+	ERR_MAGAZINE_TOO_FEW,
+	// Hash map errors:
+	ERR_HASHMAP_OUT_OF_MEMORY,
+	ERR_HASHMAP_PROBE_TOO_LONG,
 
 	// Physical memory manager errors:
 	ERR_PMM_INIT,
@@ -27,6 +32,13 @@ enum grouperError {
 	ERR_PMM_REGION_LIST_FULL,
 	ERR_PMM_REGION_ALLOCATED_FROM,
 	ERR_PMM_REGION_NOT_MANAGED,
+	ERR_PMM_INVALID_FREE,
+	ERR_PMM_BAD_HUGE_ORDER,
+	ERR_PMM_CANNOT_EXTEND,
+
+	// Kernel heap errors
+	ERR_KMALLOC_INIT,
+	ERR_KMALLOC_INVALID_FREE,
 
 	// Paging errors
 	ERR_PAGING_UNALIGNED_ADDRESS,
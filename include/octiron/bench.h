@@ -0,0 +1,20 @@
+/// Micro-benchmarks of the kernel's allocators, built with -DOCTIRON_BENCHMARKS=ON and run from kmain once the pmm
+/// manages all of the RAM. Results are reported in cycles from rdcycle.
+#pragma once
+
+#include <kzadhbat/types/numeric_types.h>
+
+/// Runs every benchmark.
+void bench_run_all(void);
+/// Chases pointers through the first pmmBlock sized object of a set of slab regions, with and without cache
+/// coloring. Without coloring all of the objects share a cache set and thrash it.
+void bench_slab_coloring(void);
+/// Inserts, looks up (hits and misses) and removes frame address keys in a kmalloc backed HashMap<u64, u64>, next to
+/// the linear scan over an array the same lookups take without it.
+void bench_hashmap(void);
+/// Times memset, memcpy (with an aligned and a misaligned source) and an overlapping memmove on sizes from 8 B to
+/// 2 MiB, growing eightfold.
+void bench_memory(void);
+/// Times strlen and strcmp against the byte at a time loops they replaced, on device tree property names packed at
+/// arbitrary alignments.
+void bench_strings(void);
@@ -0,0 +1,17 @@
+/// Zeroing of whole pages.
+///
+/// Pages are cleared with cbo.zero (Zicboz) when every hart of the device tree advertises it, a cache block at a
+/// time, without reading the old contents in. Otherwise, and until clear_page_initialize ran, they are cleared
+/// with memset.
+#pragma once
+
+#include <kzadhbat/types/numeric_types.h>
+
+/// @brief  Selects cbo.zero for clearing pages if the device tree advertises Zicboz with a usable block size.
+void clear_page_initialize(void);
+/// @brief  Returns the cache block size cleared by cbo.zero, or 0 if pages are cleared with stores.
+size_t clear_page_block_size(void);
+/// @brief  Zeroes the BASE_PAGE_SIZE aligned page at page.
+void clear_page(void *page);
+/// @brief  Zeroes the count contiguous BASE_PAGE_SIZE aligned pages starting at pages.
+void clear_pages(void *pages, size_t count);
@@ -1,4 +1,8 @@
 /// Defines a macro programmed Dynamic Array<T> type and helper macros to interact with the type.
+///
+/// Arrays start out empty and grow by doubling. Storage of up to KMALLOC_MAX_SIZE bytes comes from kmalloc, larger
+/// storage from whole pmm frames, which are extended in place when the frames following them are free. The old
+/// storage is freed whenever the array moves.
 #pragma once
 
 #include <kzadhbat/libc/string.h>
@@ -6,6 +10,16 @@
 
 #include <octiron/pmm.h>
 
+/// Capacity of an array after its first push.
+#define ARRAY_MIN_CAPACITY 4
+
+/// @brief  Moves the used bytes of data (with old_capacity bytes of storage) into storage of at least *capacity bytes,
+///         freeing the old storage unless it could be extended in place. *capacity is updated to the usable size of
+///         the new storage. Returns NULL if out of memory, data is left untouched in that case.
+void *array_storage_resize(void *data, size_t used, size_t old_capacity, size_t *capacity);
+/// @brief  Frees the storage of an array.
+void array_storage_free(void *data);
+
 /// The Array<T> type
 #define ARRAY(t) ARRAY_STR(t)
 #define ARRAY_STR(t) Array_##t
@@ -50,21 +64,51 @@
 	}
 #define ARRAY_INIT_HELPER(type) ARRAY(type)
 
+/// Moves the elements of the array into storage for (at least) new_capacity elements.
+#define ARRAY_RESIZE(array, new_capacity)                                                                       \
+	do {                                                                                                    \
+		size_t bytes = (new_capacity) * sizeof(*(array).data);                                          \
+		void *new_data = array_storage_resize((array).data, (array).size * sizeof(*(array).data),       \
+						      (array).capacity * sizeof(*(array).data), &bytes);        \
+		if (new_data == NULL) {                                                                         \
+			PANIC_LOOP("ARRAY failed to allocate memory from the kernel heap.");                    \
+		}                                                                                               \
+		(array).capacity = bytes / sizeof(*(array).data);                                               \
+		(array).data = (typeof((array).data))new_data;                                                  \
+	} while (0)
+
+/// Makes room for at least count elements, so that pushing up to that many never reallocates.
+#define ARRAY_RESERVE(array, count)                       \
+	do {                                              \
+		size_t reserve = (count);                 \
+		if (reserve > (array).capacity) {         \
+			ARRAY_RESIZE(array, reserve);     \
+		}                                         \
+	} while (0)
+
+/// Moves the elements into the smallest storage holding them, freeing the storage of an empty array.
+#define ARRAY_SHRINK_TO_FIT(array)                              \
+	do {                                                    \
+		if ((array).size == 0) {                        \
+			ARRAY_FREE(array);                      \
+		} else if ((array).size < (array).capacity) {   \
+			ARRAY_RESIZE(array, (array).size);      \
+		}                                               \
+	} while (0)
+
+/// Frees the storage of the array, leaving it empty.
+#define ARRAY_FREE(array)                            \
+	do {                                         \
+		array_storage_free((array).data);    \
+		(array).data = NULL;                 \
+		(array).size = 0;                    \
+		(array).capacity = 0;                \
+	} while (0)
+
 #define ARRAY_PUSH(array, value)                                                                                \
 	do {                                                                                                    \
 		if ((array).size >= (array).capacity) {                                                         \
-			size_t new_capacity = (array).capacity ? (array).capacity * 2 :                         \
-								 BASE_PAGE_SIZE / sizeof(*(array).data);        \
-			u8 *new_data = NULL;                                                                    \
-			if (err_is_fail(pmm_alloc_aligned(new_capacity * sizeof(*(array).data), BASE_PAGE_SIZE, \
-							  &new_data))) {                                        \
-				PANIC_LOOP("ARRAY failed to allocate memory from the kernel pmm.");             \
-			}                                                                                       \
-			if ((array).data != NULL) {                                                             \
-				memcpy(new_data, (array).data, (array).size * sizeof(*(array).data));           \
-			}                                                                                       \
-			(array).capacity = new_capacity;                                                        \
-			(array).data = (typeof((array).data))new_data;                                          \
+			ARRAY_RESIZE(array, (array).capacity ? (array).capacity * 2 : ARRAY_MIN_CAPACITY);      \
 		}                                                                                               \
 		(array).data[(array).size++] = value;                                                           \
 	} while (0)
@@ -95,4 +139,4 @@
 /// To define an ARRAY(const pointer type) type, use ARRAY(CONST(PTR(type))
 #define CONST(type) CONST_HELPER(type)
 #define CONST_HELPER(type) const_##type
-#endif
\ No newline at end of file
+#endif
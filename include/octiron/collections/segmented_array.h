@@ -0,0 +1,94 @@
+/// Defines a macro programmed Segmented Array<T> type and helper macros to interact with the type.
+///
+/// Unlike ARRAY, elements live in fixed size segments of BASE_PAGE_SIZE bytes that are never moved once allocated, so
+/// pointers to elements stay valid as the array grows. Only the directory of segment pointers is reallocated, and
+/// indexing remains a division and a remainder by a constant.
+#pragma once
+
+#include <kzadhbat/libc/string.h>
+#include <kzadhbat/assert.h>
+#include <kzadhbat/arch/riscv.h>
+
+#include <octiron/pmm.h>
+
+/// The Segmented Array<T> type
+#define SEG_ARRAY(t) SEG_ARRAY_STR(t)
+#define SEG_ARRAY_STR(t) SegArray_##t
+
+/// Declares and defines a Segmented Array<T> type.
+#define DEFINE_SEG_ARRAY(t)             \
+	typedef struct {                \
+		t **segments;           \
+		size_t size;            \
+		size_t segment_count;   \
+		size_t directory_size;  \
+	} SEG_ARRAY(t)
+
+/// Declares and defines a Segmented Array<struct T> type.
+#define DEFINE_SEG_ARRAY_STRUCT(t)      \
+	typedef struct {                \
+		struct t **segments;    \
+		size_t size;            \
+		size_t segment_count;   \
+		size_t directory_size;  \
+	} SEG_ARRAY(STRUCT(t))
+
+/// Initializes a Segmented Array<T> without any segments
+#define SEG_ARRAY_INIT(type)                                                        \
+	(SEG_ARRAY_INIT_HELPER(type))                                               \
+	{                                                                           \
+		.segments = NULL, .size = 0, .segment_count = 0, .directory_size = 0 \
+	}
+#define SEG_ARRAY_INIT_HELPER(type) SEG_ARRAY(type)
+
+/// Number of elements held by every segment of the array.
+#define SEG_ARRAY_PER_SEGMENT(array) (BASE_PAGE_SIZE / sizeof(**(array).segments))
+
+/// Pointer to the element at index i, which must be smaller than the size of the array.
+#define SEG_ARRAY_AT(array, i) (&(array).segments[(i) / SEG_ARRAY_PER_SEGMENT(array)][(i) % SEG_ARRAY_PER_SEGMENT(array)])
+
+/// Pointer to the element pushed last.
+#define SEG_ARRAY_LAST(array) SEG_ARRAY_AT(array, (array).size - 1)
+
+#define SEG_ARRAY_PUSH(array, value)                                                                             \
+	do {                                                                                                     \
+		_Static_assert(sizeof(**(array).segments) <= BASE_PAGE_SIZE,                                     \
+			       "SEG_ARRAY elements must fit into a segment");                                     \
+		if ((array).size == (array).segment_count * SEG_ARRAY_PER_SEGMENT(array)) {                       \
+			if ((array).segment_count == (array).directory_size) {                                   \
+				/* Only the segment pointers move, the elements stay where they are */           \
+				size_t new_size = (array).directory_size ? (array).directory_size * 2 :          \
+									   BASE_PAGE_SIZE / sizeof(void *);      \
+				u8 *new_directory = NULL;                                                        \
+				if (err_is_fail(pmm_alloc_flags(new_size * sizeof(void *), BASE_PAGE_SIZE,        \
+								PMM_ALLOC_NO_ZERO, &new_directory))) {           \
+					PANIC_LOOP("SEG_ARRAY failed to allocate memory from the kernel pmm.");  \
+				}                                                                                \
+				if ((array).segments != NULL) {                                                  \
+					memcpy(new_directory, (array).segments,                                  \
+					       (array).segment_count * sizeof(void *));                          \
+					pmm_free((u8 *)(array).segments);                                        \
+				}                                                                                \
+				(array).directory_size = new_size;                                               \
+				(array).segments = (typeof((array).segments))new_directory;                      \
+			}                                                                                        \
+			u8 *new_segment = NULL;                                                                  \
+			if (err_is_fail(pmm_alloc_flags(BASE_PAGE_SIZE, BASE_PAGE_SIZE, PMM_ALLOC_NO_ZERO,       \
+							&new_segment))) {                                        \
+				PANIC_LOOP("SEG_ARRAY failed to allocate memory from the kernel pmm.");          \
+			}                                                                                        \
+			(array).segments[(array).segment_count++] = (typeof(*(array).segments))new_segment;      \
+		}                                                                                                \
+		*SEG_ARRAY_AT(array, (array).size) = value;                                                      \
+		(array).size++;                                                                                  \
+	} while (0)
+
+#define SEG_ARRAY_SIZE(array) ((array).size)
+#define SEG_ARRAY_CAPACITY(array) ((array).segment_count * SEG_ARRAY_PER_SEGMENT(array))
+
+#ifndef STRUCT
+/// Used as a work around for macro defined types that contain a struct type
+/// To define a SEG_ARRAY(struct type) type, use SEG_ARRAY(STRUCT(type)).
+#define STRUCT(type) STRUCT_HELPER(type)
+#define STRUCT_HELPER(type) struct_##type
+#endif
@@ -7,6 +7,14 @@
 struct dtNode;
 struct dtProperty;
 
+/// A range of physical memory described by the device tree.
+struct dtMemoryRange {
+	/// The physical base address of the range
+	paddr_t base;
+	/// The size of the range in bytes
+	size_t size;
+};
+
 /// Initializes the device tree structure by parsing the device tree blob loacated at the given physical address.
 /// This procedure allocates it's own memory for it's internal structures and cleans up the dtb region memory after
 /// parsing the device tree blob.
@@ -16,4 +24,22 @@ errval_t dt_initialize(paddr_t dtb_base_addr);
 bool dt_is_initialized(void);
 
 /// Looks up a node in the device tree by its path and returns a reference to it.
-struct dtNode * dt_lookup_node(const char* path);
\ No newline at end of file
+struct dtNode * dt_lookup_node(const char* path);
+
+/// Writes up to max RAM ranges, taken from the reg property of every /memory node, into ranges. Returns the number
+/// of ranges described by the device tree, which may exceed max.
+size_t dt_memory_ranges(struct dtMemoryRange *ranges, size_t max);
+
+/// Writes up to max reserved ranges, taken from the memory reservation block and the /reserved-memory children, into
+/// ranges. Returns the number of ranges described by the device tree, which may exceed max.
+size_t dt_reserved_ranges(struct dtMemoryRange *ranges, size_t max);
+
+/// Returns true if every cpu node lists the ISA extension ext (e.g. "v" or "zicboz"), either in its
+/// riscv,isa-extensions string list or in its riscv,isa string.
+bool dt_cpu_has_extension(const char *ext);
+/// Returns the smallest value of the u32 property name (e.g. "riscv,cboz-block-size") over all cpu nodes, or 0 if
+/// any of them lacks it.
+u32 dt_cpu_property_u32(const char *name);
+
+/// Returns the physical range occupied by the device tree blob itself.
+struct dtMemoryRange dt_blob_range(void);
@@ -0,0 +1,25 @@
+/// General purpose kernel heap. Requests of up to KMALLOC_MAX_SIZE bytes are served from per size class object caches
+/// (see kzadhbat/collections/slab_cache.h) that grow from and shrink back into the pmm, larger requests are passed
+/// straight to the pmm as whole frames.
+#pragma once
+
+#include <kzadhbat/types/numeric_types.h>
+#include <kzadhbat/types/error.h>
+
+/// Number of size classes, see kmalloc.c for their sizes.
+#define KMALLOC_CLASS_COUNT 14
+/// Largest request served from a size class, two of them fit into a slab region.
+#define KMALLOC_MAX_SIZE 2016
+
+/// @brief  Sets up the size class caches, the pmm must be initialized.
+errval_t kmalloc_initialize(void);
+/// @brief  Allocates size bytes of uninitialized memory, aligned to at least 16 bytes. Returns NULL if out of memory.
+void *kmalloc(size_t size);
+/// @brief  Returns the number of bytes kmalloc(size) actually hands out, all of which the caller may use.
+size_t kmalloc_size(size_t size);
+/// @brief  Returns memory handed out by kmalloc, NULL is ignored.
+errval_t kfree(void *ptr);
+/// @brief  Returns the empty slab regions of the size classes to the pmm, along with the objects cached for this hart.
+void kmalloc_reclaim(void);
+/// @brief  Prints the occupancy and magazine hit ratio of every size class.
+void kmalloc_print_stats(void);
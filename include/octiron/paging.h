@@ -26,6 +26,9 @@ enum sv39_pageType {
 	sv39_GigaPage, ///< 1 GiB Page
 };
 
+/// The sizes of the leaf pages, indexed by enum sv39_pageType.
+extern const u64 sv39_pageSizes[];
+
 /// The flags for the SV39 table entry.
 enum sv39_tableEntryFlags {
 	SV39_FLAGS_VALID = 0b00000001, ///< Valid bit
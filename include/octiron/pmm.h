@@ -8,21 +8,103 @@ enum pmmPolicy {
 	PMM_POLICY_FIRST_FIT, ///< First fit allocation policy.
 	PMM_POLICY_BEST_FIT, ///< Best fit allocation policy.
 	PMM_POLICY_WORST_FIT, ///< Worst fit allocation policy.
+	PMM_POLICY_BUDDY, ///< Power-of-two buddy allocation policy.
+	PMM_POLICY_BITMAP, ///< First fit over a bitmap with one bit per frame.
 };
 
-/// @brief  Initializes the physical memory manager.
-errval_t pmm_initialize(void);
+/// Allocation flags for pmm_alloc_flags.
+#define PMM_ALLOC_NO_ZERO (1 << 0) ///< The caller overwrites the memory anyway, hand it out without zeroing it.
+
+/// Frame orders accepted by pmm_alloc_huge, 2^order BASE_PAGE_SIZE frames for an sv39 mega or giga page.
+#define PMM_HUGE_ORDER_MEGA 9
+#define PMM_HUGE_ORDER_GIGA 18
+
+/// Frames kept pre-zeroed in the zero pool, refilled from the idle loop with pmm_zero_pool_refill.
+#define PMM_ZERO_POOL_TARGET 64
+
+/// What a frame is used for, kept in its pmmFrame descriptor.
+enum pmmFrameType {
+	PMM_FRAME_FREE, ///< Free, or parked in one of the pmm's caches.
+	PMM_FRAME_RESERVED, ///< Removed from the pmm, or backing the pmm's own metadata.
+	PMM_FRAME_KERNEL, ///< Handed out by the pmm, the type of every fresh allocation.
+	PMM_FRAME_PAGE_TABLE, ///< Backs a page table.
+	PMM_FRAME_SLAB, ///< Backs a slab allocator.
+	PMM_FRAME_USER, ///< Backs user memory.
+};
+
+/// Flags of a pmmFrame descriptor.
+#define PMM_FRAME_HEAD (1 << 0) ///< The frame starts an allocation and holds its reference count.
+#define PMM_FRAME_HUGE (1 << 1) ///< The frame is part of a mega or giga frame handed out by pmm_alloc_huge.
+
+/// Per frame descriptor, one for every BASE_PAGE_SIZE frame managed by the pmm. Four of them share a cache line.
+struct pmmFrame {
+	/// @brief  References held on the allocation, only kept by its first frame.
+	u32 refcount;
+	/// @brief  Page table entries mapping the frame.
+	u32 mapcount;
+	/// @brief  PMM_FRAME_* flags.
+	u32 flags;
+	/// @brief  One of enum pmmFrameType.
+	u16 type;
+	/// @brief  Owner of the frame, interpreted by its type (an address space, a slab cache, ...).
+	u16 owner;
+};
+SASSERT(sizeof(struct pmmFrame) == 16, "pmmFrame must be 16 bytes wide");
+
+struct pmmZeroPoolStats {
+	/// @brief  Zeroed single frame allocations served from the pool.
+	u64 hits;
+	/// @brief  Zeroed single frame allocations that had to be zeroed synchronously.
+	u64 misses;
+	/// @brief  Frames zeroed ahead of time by pmm_zero_pool_refill.
+	u64 refills;
+	/// @brief  Frames currently held by the pool.
+	size_t pooled;
+};
+
+/// @brief  Initializes the physical memory manager with the given allocation policy.
+errval_t pmm_initialize(enum pmmPolicy policy);
 /// @brief  Adds a new memory region to the physical memory manager.
 errval_t pmm_add_region(void *base, size_t size);
 /// @brief  Removes a contiguous region from the physical memory manager.
 errval_t pmm_remove_region(paddr_t base, size_t size);
-/// @brief  Allocates a region of memory with the requested size and alignment.
+/// @brief  Allocates a zeroed region of memory with the requested size and alignment.
 errval_t pmm_alloc_aligned(size_t size, size_t alignment, u8 **ret);
-/// @brief  Allocates a region of memory with the requested size and BASE_PAGE_SIZE alignment.
+/// @brief  Allocates a region of memory with the requested size and alignment, flags is a set of PMM_ALLOC_* flags.
+errval_t pmm_alloc_flags(size_t size, size_t alignment, u32 flags, u8 **ret);
+/// @brief  Allocates a zeroed region of memory with the requested size and BASE_PAGE_SIZE alignment.
 errval_t pmm_alloc(size_t size, u8 **ret);
-/// @brief  Returns a previously allocated memory region to the allocator.
+/// @brief  Allocates a naturally aligned mega or giga frame of 2^order frames, flags is a set of PMM_ALLOC_* flags.
+errval_t pmm_alloc_huge(size_t order, u32 flags, u8 **ret);
+/// @brief  Returns a previously allocated memory region to the allocator, ret must be the address handed out.
 errval_t pmm_free(u8 *ret);
+/// @brief  Grows the allocation based at base to size bytes without moving it, if the frames following it are free.
+errval_t pmm_extend(u8 *base, size_t size);
+/// @brief  Allocates count zeroed, independent BASE_PAGE_SIZE frames in a single pass, all of them or none.
+errval_t pmm_alloc_batch(size_t count, u8 **frames);
+/// @brief  Returns count frames to the allocator in a single pass, they need not come from the same batch.
+errval_t pmm_free_batch(size_t count, u8 **frames);
+/// @brief  Returns the descriptor of the frame holding addr, or NULL if addr is not managed by the pmm.
+struct pmmFrame *pmm_frame(paddr_t addr);
+/// @brief  Sets the type and owner of every frame of the allocation based at base.
+errval_t pmm_frame_set_type(u8 *base, enum pmmFrameType type, u16 owner);
+/// @brief  Takes another reference on the allocation based at base.
+errval_t pmm_frame_get(u8 *base);
+/// @brief  Drops a reference on the allocation based at base, freeing it with the last one.
+errval_t pmm_frame_put(u8 *base);
+/// @brief  Returns the amount of memory taken by the frame descriptors.
+size_t pmm_frame_db_mem(void);
 /// @brief  Returns the total amount of memory this pmm manages.
 size_t pmm_total_mem(void);
-/// @brief  Returns the total amount of free memory this pmm manages.
-size_t pmm_free_mem(void);
\ No newline at end of file
+/// @brief  Returns the total amount of free memory this pmm manages, not counting the per-hart page caches.
+size_t pmm_free_mem(void);
+/// @brief  Returns the amount of free memory held back in intact huge frames, part of pmm_free_mem.
+size_t pmm_huge_mem(void);
+/// @brief  Returns the amount of free memory parked in the per-hart page caches.
+size_t pmm_cached_mem(void);
+/// @brief  Zeroes up to budget free frames into the zero pool, returning how many were added. Meant for idle time.
+size_t pmm_zero_pool_refill(size_t budget);
+/// @brief  Returns the hit and miss counters of the zero pool.
+void pmm_zero_pool_stats(struct pmmZeroPoolStats *stats);
+/// @brief  Prints the usage statistics of the pmm and the hit rates of its page caches.
+void pmm_print_stats(void);
\ No newline at end of file
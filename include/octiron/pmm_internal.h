@@ -0,0 +1,254 @@
+/// Internal state of the physical memory manager, shared between the pmm front-end (src/octiron/pmm.c) and its
+/// allocation backends. Nothing outside of the pmm should include this header.
+#pragma once
+
+#include <octiron/pmm.h>
+
+#include <kzadhbat/types/numeric_types.h>
+#include <kzadhbat/types/error.h>
+#include <kzadhbat/arch/riscv.h>
+#include <kzadhbat/collections/slab.h>
+#include <kzadhbat/collections/magazine.h>
+#include <kzadhbat/sync/spinlock.h>
+
+#define PMM_REGION_COUNT 16
+/// Magazines backing the per-hart page caches, two per hart plus those parked in the depot.
+#define PMM_PAGE_MAGAZINE_COUNT (MAGAZINE_PER_HART * MAGAZINE_MAX_HARTS + 16)
+
+/// Free pmmBlocks kept in reserve while the block slab refills itself, an allocation takes at most two.
+#define PMM_BLOCK_WATERMARK 8
+
+/// Frames requested from a backend at once when serving a batch of single frames.
+#define PMM_BATCH_CHUNK 32
+/// Frames the extent backend carves at once when serving a batch of single frames.
+#define PMM_EXTENT_BATCH_RUN 16
+
+/// Huge frames are held back from the backends in naturally aligned 2 MiB slots, a region tracks up to
+/// PMM_HUGE_SLOTS of them (4 GiB). Giga frames take PMM_HUGE_GIGA_SLOTS intact slots of a 1 GiB aligned group.
+#define PMM_HUGE_SLOT_SIZE ((size_t)BASE_PAGE_SIZE << PMM_HUGE_ORDER_MEGA)
+#define PMM_HUGE_GIGA_SIZE ((size_t)BASE_PAGE_SIZE << PMM_HUGE_ORDER_GIGA)
+#define PMM_HUGE_GIGA_SLOTS (PMM_HUGE_GIGA_SIZE / PMM_HUGE_SLOT_SIZE)
+#define PMM_HUGE_SLOTS 2048
+#define PMM_HUGE_WORDS (PMM_HUGE_SLOTS / 64)
+
+/// Converts between physical addresses and physical frame numbers.
+#define PMM_PFN(addr) ((paddr_t)(addr) / BASE_PAGE_SIZE)
+#define PMM_PFN_ADDR(pfn) ((paddr_t)(pfn) * BASE_PAGE_SIZE)
+
+/// The largest buddy order, blocks of 2^PMM_BUDDY_MAX_ORDER frames (1 GiB with 4 KiB frames).
+#define PMM_BUDDY_MAX_ORDER 18
+#define PMM_BUDDY_ORDER_COUNT (PMM_BUDDY_MAX_ORDER + 1)
+
+/// Buddy frame state bits, one byte per frame. The low bits hold the order of the block headed by the frame.
+#define PMM_BUDDY_FREE 0x80 ///< The frame heads a free block.
+#define PMM_BUDDY_RESERVED 0x40 ///< The frame was carved out with pmm_remove_region and can never be freed.
+#define PMM_BUDDY_HEAD 0x20 ///< The frame heads an allocated block.
+#define PMM_BUDDY_ORDER_MASK 0x1F
+
+struct pmmBlock {
+	/// @brief  Base address of the block.
+	paddr_t base;
+	/// @brief  Size of the block in bytes.
+	size_t size;
+	/// @brief  Pointer to the next free block in the region.
+	struct pmmBlock *next;
+	/// @brief  Pointer to the previous free block in the region.
+	struct pmmBlock *prev;
+	/// @brief  Children in the region's size index (free blocks) or allocation index (allocation records).
+	struct pmmBlock *left;
+	struct pmmBlock *right;
+};
+SASSERT(sizeof(struct pmmBlock) == 48, "pmmBlock must be 48 bytes wide");
+
+/// Free buddy blocks are linked through their own first bytes.
+struct pmmBuddyBlock {
+	struct pmmBuddyBlock *next;
+	struct pmmBuddyBlock *prev;
+};
+
+struct pmmBuddy {
+	/// @brief  Free lists of naturally aligned blocks, indexed by order.
+	struct pmmBuddyBlock *free_lists[PMM_BUDDY_ORDER_COUNT];
+	/// @brief  Per frame state bytes, indexed by the frame's offset into the region.
+	u8 *frames;
+};
+
+struct pmmBitmap {
+	/// @brief  One bit per frame, set while the frame is allocated.
+	u64 *used;
+	/// @brief  One bit per frame, set on the last frame of every allocation so pmm_free can find its extent.
+	u64 *ends;
+	/// @brief  One bit per frame, set on the frames of the bitmaps themselves and of the ranges taken with
+	/// pmm_bitmap_reserve. They are used but belong to no allocation, so pmm_free rejects them.
+	u64 *reserved;
+	/// @brief  Number of frames tracked by the bitmaps.
+	size_t frame_count;
+	/// @brief  Index of the lowest frame that may be free.
+	size_t hint;
+};
+
+struct pmmHuge {
+	/// @brief  Base address of the first slot, the first 2 MiB boundary past the backend's metadata.
+	paddr_t base;
+	/// @brief  Number of slots that fit inside of the region.
+	size_t slot_count;
+	/// @brief  Slots held back from the backend as a whole, free for pmm_alloc_huge.
+	u64 intact[PMM_HUGE_WORDS];
+	/// @brief  Slots handed out by pmm_alloc_huge.
+	u64 allocated[PMM_HUGE_WORDS];
+	/// @brief  First slot of every giga frame handed out by pmm_alloc_huge.
+	u64 giga[PMM_HUGE_WORDS];
+	/// @brief  Slots that overlap a range removed from the pmm, they never re-form.
+	u64 pinned[PMM_HUGE_WORDS];
+	/// @brief  Frames the backend has handed out of every broken slot, the slot re-forms once it drops to zero.
+	u16 used[PMM_HUGE_SLOTS];
+};
+
+struct pmmRegion {
+	/// @brief  The base address of the region.
+	paddr_t base;
+	/// @brief  Length of the region in bytes.
+	size_t size;
+	/// @brief  Count of total bytes free in this region.
+	size_t free;
+	/// @brief  Bytes of the region consumed by the backend's own metadata.
+	size_t metadata;
+	/// @brief  Size of the largest free extent, an upper bound for backends that can't tell cheaply.
+	size_t largest_free;
+	/// @brief  Address ordered free list of blocks in this region (extent policies).
+	struct pmmBlock *free_blocks;
+	/// @brief  Treap of the free blocks keyed by (size, base) (extent policies).
+	struct pmmBlock *size_tree;
+	/// @brief  Treap of the allocations made from this region keyed by base (extent policies).
+	struct pmmBlock *alloc_tree;
+	/// @brief  Buddy allocator state (buddy policy).
+	struct pmmBuddy buddy;
+	/// @brief  Bitmap allocator state (bitmap policy).
+	struct pmmBitmap bitmap;
+	/// @brief  Huge frame slots held back from the backend.
+	struct pmmHuge huge;
+	/// @brief  Descriptors of the frames of the region indexed by their offset into it, carved from the region.
+	struct pmmFrame *frames;
+};
+
+/// Pre-zeroed frames are linked through their first word, which is cleared again when the frame is handed out.
+struct pmmZeroFrame {
+	struct pmmZeroFrame *next;
+};
+
+struct pmmZeroPool {
+	/// @brief  Protects the pool, held only for the push or pop and never while zeroing.
+	struct spinlock lock;
+	/// @brief  Stack of zeroed frames.
+	struct pmmZeroFrame *frames;
+	/// @brief  Counters, see struct pmmZeroPoolStats.
+	struct pmmZeroPoolStats stats;
+};
+
+struct pmm {
+	/// @brief  Serializes access to the regions and the backends, the page cache is lock-free.
+	struct spinlock lock;
+	/// @brief  Per-hart cache of free BASE_PAGE_SIZE frames in front of the backends.
+	struct magazineCache page_cache;
+	/// @brief  Frames zeroed ahead of time, they count as allocated for the backends.
+	struct pmmZeroPool zero_pool;
+	/// @brief  List of contiguous regions from which memory can be allocated.
+	struct pmmRegion regions[PMM_REGION_COUNT];
+	/// @brief  Number of regions in the list.
+	size_t region_count;
+	/// @brief  Slab allocator for mmBlock structures.
+	struct slabAllocator block_allocator;
+	/// @brief  Total amount of memory managed by the allocator.
+	size_t total;
+	/// @brief  Total amount of free memory managed by the backends.
+	size_t free;
+	/// @brief  Free memory held back in intact huge frame slots, not part of free.
+	size_t huge_free;
+	/// @brief  Memory taken by the frame descriptors of all regions.
+	size_t frame_db;
+	/// @brief  The policy used for allocation.
+	enum pmmPolicy policy;
+	/// @brief  Check whether the pmm is initialized.
+	bool initialized;
+};
+
+extern struct pmm pmm;
+
+/// Returns the region managing addr, or NULL if addr is not managed by the pmm.
+struct pmmRegion *pmm_find_region(paddr_t addr);
+/// Returns the size of the allocation based at base, or 0 if base does not start an allocation.
+size_t pmm_block_size(paddr_t base);
+/// pmm_block_size for callers that hold pmm.lock.
+size_t pmm_block_size_locked(paddr_t base);
+
+/// Permanently removes [base, base + size) from the free memory of the region's backend.
+errval_t pmm_backend_reserve(struct pmmRegion *region, paddr_t base, size_t size);
+/// Returns a range removed with pmm_backend_reserve to the region's backend.
+errval_t pmm_backend_release(struct pmmRegion *region, paddr_t base, size_t size);
+
+// Frame database (src/octiron/pmm_frames.c)
+
+/// Carves the frame descriptors of a freshly added region from the region itself, right after the backend metadata.
+errval_t pmm_frames_region_init(struct pmmRegion *region);
+/// Resets the descriptors of [base, base + size) to type, without any references or flags.
+void pmm_frames_mark(struct pmmRegion *region, paddr_t base, size_t size, enum pmmFrameType type);
+/// Marks [base, base + size) as a fresh allocation holding a single reference, flags go to every frame.
+void pmm_frames_claim(struct pmmRegion *region, paddr_t base, size_t size, u32 flags);
+
+// Extent backend (src/octiron/pmm_extent.c)
+
+/// Sets up a freshly added region as a single free extent.
+errval_t pmm_extent_region_init(struct pmmRegion *region);
+/// Releases the free extents of a region that is being removed, the region must not have any allocations left.
+void pmm_extent_region_release(struct pmmRegion *region);
+/// Allocates size bytes aligned to alignment from the free extent picked by the first, best or worst fit policy.
+errval_t pmm_extent_alloc(struct pmmRegion *region, size_t size, size_t alignment, enum pmmPolicy policy,
+			  paddr_t *ret);
+/// Allocates up to count single frames, returning how many were handed out.
+size_t pmm_extent_alloc_batch(struct pmmRegion *region, paddr_t *frames, size_t count);
+/// Returns the size of the allocation based at base, or 0 if base does not start an allocation.
+size_t pmm_extent_block_size(struct pmmRegion *region, paddr_t base);
+/// Returns the allocation based at base to the region, coalescing it with its free neighbours.
+errval_t pmm_extent_free(struct pmmRegion *region, paddr_t base, size_t *freed);
+/// Permanently removes [base, base + size) from the free extents of the region.
+errval_t pmm_extent_reserve(struct pmmRegion *region, paddr_t base, size_t size);
+/// Returns a range removed with pmm_extent_reserve to the free extents of the region.
+errval_t pmm_extent_release(struct pmmRegion *region, paddr_t base, size_t size);
+/// Grows the allocation based at base to size bytes into the free extent following it, returning its old size.
+errval_t pmm_extent_extend(struct pmmRegion *region, paddr_t base, size_t size, size_t *old_size);
+
+// Buddy backend (src/octiron/pmm_buddy.c)
+
+/// Sets up the buddy metadata for a freshly added region, carving the frame state bytes from the region itself.
+errval_t pmm_buddy_region_init(struct pmmRegion *region);
+/// Allocates a naturally aligned block of at least size bytes, returning the size of the block handed out.
+errval_t pmm_buddy_alloc(struct pmmRegion *region, size_t size, size_t alignment, paddr_t *ret, size_t *allocated);
+/// Allocates up to count single frames, splitting as few blocks as possible. Returns how many were handed out.
+size_t pmm_buddy_alloc_batch(struct pmmRegion *region, paddr_t *frames, size_t count);
+/// Returns the size of the allocated block headed by base, or 0 if base does not head an allocated block.
+size_t pmm_buddy_block_size(struct pmmRegion *region, paddr_t base);
+/// Returns the block headed by base to the region, coalescing it with its free buddies.
+errval_t pmm_buddy_free(struct pmmRegion *region, paddr_t base, size_t *freed);
+/// Permanently removes [base, base + size) from the free blocks of the region.
+errval_t pmm_buddy_reserve(struct pmmRegion *region, paddr_t base, size_t size);
+/// Returns a range removed with pmm_buddy_reserve to the free lists of the region.
+errval_t pmm_buddy_release(struct pmmRegion *region, paddr_t base, size_t size);
+
+// Bitmap backend (src/octiron/pmm_bitmap.c)
+
+/// Sets up the frame bitmaps for a freshly added region, carving them from the region itself.
+errval_t pmm_bitmap_region_init(struct pmmRegion *region);
+/// Allocates size bytes of contiguous frames aligned to alignment.
+errval_t pmm_bitmap_alloc(struct pmmRegion *region, size_t size, size_t alignment, paddr_t *ret);
+/// Allocates up to count single frames, taking the free bits of a word at a time. Returns how many were handed out.
+size_t pmm_bitmap_alloc_batch(struct pmmRegion *region, paddr_t *frames, size_t count);
+/// Returns the size of the allocation based at base, or 0 if base does not start an allocation.
+size_t pmm_bitmap_block_size(struct pmmRegion *region, paddr_t base);
+/// Returns the allocation based at base to the region.
+errval_t pmm_bitmap_free(struct pmmRegion *region, paddr_t base, size_t *freed);
+/// Permanently removes [base, base + size) from the free frames of the region.
+errval_t pmm_bitmap_reserve(struct pmmRegion *region, paddr_t base, size_t size);
+/// Returns a range removed with pmm_bitmap_reserve to the free frames of the region.
+errval_t pmm_bitmap_release(struct pmmRegion *region, paddr_t base, size_t size);
+/// Grows the allocation based at base to size bytes over the free frames following it, returning its old size.
+errval_t pmm_bitmap_extend(struct pmmRegion *region, paddr_t base, size_t size, size_t *old_size);
@@ -0,0 +1,35 @@
+/// Management of the RISC-V vector unit (V extension) in S-mode.
+///
+/// The unit starts out Off (sstatus.VS), vector_initialize turns it on when the kernel was built with the RVV
+/// routines (-DKZADHBAT_RVV=ON) and every hart of the device tree has V, and switches the libc routines over to it.
+/// Code that interrupts a vector user (traps, context switches) has to save the vector state with vector_save before
+/// touching vector registers itself, and give it back with vector_restore.
+#pragma once
+
+#include <kzadhbat/types/numeric_types.h>
+#include <kzadhbat/types/error.h>
+
+/// The architectural vector state of a hart.
+struct vectorState {
+	u64 vstart;
+	u64 vtype;
+	u64 vl;
+	u64 vcsr;
+	/// The 32 vector registers, vector_state_size() bytes.
+	u8 *registers;
+	/// Set once vector_save stored the registers, vector_restore leaves the hart alone until then. A new state
+	/// has to start out zeroed.
+	bool saved;
+};
+
+/// @brief  Turns the vector unit on if it can be used, and selects the vector libc routines.
+errval_t vector_initialize(void);
+/// @brief  Returns true if vector_initialize turned the vector unit on.
+bool vector_available(void);
+/// @brief  Returns the size of the registers buffer of a vectorState, 32 times the vector register length.
+size_t vector_state_size(void);
+/// @brief  Saves the vector state of the hart into state, unless sstatus.VS says it is Clean and state already holds
+///         it. Leaves the state Clean.
+void vector_save(struct vectorState *state);
+/// @brief  Loads the vector state of the hart from state, leaving it Clean. Does nothing if state was never saved.
+void vector_restore(struct vectorState *state);
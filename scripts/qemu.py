@@ -16,6 +16,9 @@ def main():
     parser = argparse.ArgumentParser(description="Runs QEMU with a given riscv64 kernel on the virt machine.")
     parser.add_argument("--kernel", "-k", required=True, help="Path to the kernel ELF file.")
 
+    parser.add_argument("--vector", default=False, action=argparse.BooleanOptionalAction,
+                        help="Exposes the RISC-V vector extension (V) to the guest.")
+
     group = parser.add_mutually_exclusive_group()
     group.add_argument("--gdb", default=False, action=argparse.BooleanOptionalAction,
                     help="Runs QEMU in the background and launches GDB for debugging.")
@@ -27,7 +30,7 @@ def main():
     qemu_args = [
         QEMU_BINARY,
         "-M", "virt",
-        "-cpu", "rv64",
+        "-cpu", "rv64,v=true,vlen=256" if args.vector else "rv64",
         "-smp", "2",
         "-m", "4G",
         "-nographic",
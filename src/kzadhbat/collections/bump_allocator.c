@@ -2,47 +2,59 @@
 #include <kzadhbat/libc/string.h>
 #include <kzadhbat/bitmacros.h>
 
-// Forward declarations
-void *bump_alloc(struct bumpAllocator *allocator, size_t size);
-void *bump_copy(struct bumpAllocator *allocator, const void *src, size_t size);
-const char *bump_copy_string(struct bumpAllocator *allocator, void *src);
-void *bump_alloc_aligned(struct bumpAllocator *allocator, size_t size, size_t alignment);
-
-errval_t bump_init(struct bumpAllocator *allocator, u8 *memory, size_t size)
+errval_t bump_init(struct bumpAllocator *bump, bump_refill_func_t refill, bump_release_func_t release)
 {
-	if (allocator == NULL || memory == 0 || size == 0) {
+	if (bump == NULL || refill == NULL) {
 		return ERR_NULL_ARGUMENT;
 	}
 
-	allocator->memory = memory;
-	allocator->size = size;
-	allocator->index = 0;
-	allocator->alloc = bump_alloc;
-	allocator->copy = bump_copy;
-	allocator->str_copy = bump_copy_string;
-	allocator->alloc_aligned = bump_alloc_aligned;
+	// An empty allocator sends its first allocation down the slow path
+	bump->cursor = NULL;
+	bump->end = NULL;
+	bump->chunk = NULL;
+	bump->size = 0;
+	bump->chunks = 0;
+	bump->refill = refill;
+	bump->release = release;
 
 	return ERR_OK;
 }
 
-void *bump_alloc(struct bumpAllocator *allocator, size_t size)
+void *bump_alloc_chunk(struct bumpAllocator *bump, size_t size, size_t alignment)
 {
-	if (allocator == NULL || size == 0 || allocator->index + size > allocator->size) {
+	// Room for the header, the block and the worst case alignment padding in front of it
+	size_t min_size = sizeof(struct bumpChunk) + size + alignment - 1;
+	if (min_size < size) {
+		return NULL;
+	}
+	u8 *buf = NULL;
+	size_t len = 0;
+	if (err_is_fail(bump->refill(bump, min_size, &buf, &len)) || buf == NULL || len < min_size) {
 		return NULL;
 	}
 
-	void *ptr = (void *)(allocator->memory + allocator->index);
-	allocator->index += size;
-	return ptr;
+	// What is left of the previous chunk is abandoned, the chain only ever bumps at its head
+	struct bumpChunk *chunk = (struct bumpChunk *)buf;
+	chunk->prev = bump->chunk;
+	chunk->size = len;
+	bump->chunk = chunk;
+	bump->size += len;
+	bump->chunks++;
+	bump->cursor = buf + sizeof(struct bumpChunk);
+	bump->end = buf + len;
+
+	uintptr_t ptr = ALIGN_UP((uintptr_t)bump->cursor, alignment);
+	bump->cursor = (u8 *)(ptr + size);
+	return (void *)ptr;
 }
 
-void *bump_copy(struct bumpAllocator *allocator, const void *src, size_t size)
+void *bump_copy(struct bumpAllocator *bump, const void *src, size_t size)
 {
-	if (allocator == NULL || src == NULL || size == 0 || allocator->index + size > allocator->size) {
+	if (bump == NULL || src == NULL || size == 0) {
 		return NULL;
 	}
 
-	void *dest = bump_alloc(allocator, size);
+	void *dest = bump_alloc(bump, size);
 	if (dest == NULL) {
 		return NULL;
 	}
@@ -51,32 +63,46 @@ void *bump_copy(struct bumpAllocator *allocator, const void *src, size_t size)
 	return dest;
 }
 
-const char *bump_copy_string(struct bumpAllocator *allocator, void *src)
+const char *bump_copy_string(struct bumpAllocator *bump, const char *src)
 {
-	if (allocator == NULL || src == NULL) {
+	if (bump == NULL || src == NULL) {
 		return NULL;
 	}
+	return bump_copy(bump, src, strlen(src) + 1);
+}
 
-	size_t len = strlen((const char *)src) + 1;
-	if (allocator->index + len > allocator->size) {
-		return NULL;
+struct bumpMark bump_mark(struct bumpAllocator *bump)
+{
+	return (struct bumpMark){ .chunk = bump->chunk, .cursor = bump->cursor };
+}
+
+void bump_rewind(struct bumpAllocator *bump, struct bumpMark mark)
+{
+	while (bump->chunk != mark.chunk) {
+		struct bumpChunk *chunk = bump->chunk;
+		bump->chunk = chunk->prev;
+		bump->size -= chunk->size;
+		bump->chunks--;
+		if (bump->release != NULL) {
+			bump->release(bump, (u8 *)chunk);
+		}
 	}
 
-	char *dest = (char *)(allocator->memory + allocator->index);
-	memcpy(dest, src, len);
-	allocator->index += len;
-	return dest;
+	if (mark.chunk == NULL) {
+		bump->cursor = NULL;
+		bump->end = NULL;
+	} else {
+		bump->cursor = mark.cursor;
+		bump->end = (u8 *)mark.chunk + mark.chunk->size;
+	}
 }
 
-void *bump_alloc_aligned(struct bumpAllocator *allocator, size_t size, size_t alignment)
+void bump_release_all(struct bumpAllocator *bump)
 {
-	if (allocator == NULL || size == 0 || alignment == 0 ||
-	    ALIGN_UP(allocator->index, alignment) + size > allocator->size) {
-		return NULL;
-	}
-	allocator->index = ALIGN_UP(allocator->index, alignment);
+	bump_rewind(bump, (struct bumpMark){ .chunk = NULL, .cursor = NULL });
+}
 
-	void *ptr = (void *)(allocator->memory + allocator->index);
-	allocator->index += size;
-	return ptr;
-}
\ No newline at end of file
+size_t bump_size(struct bumpAllocator *bump)
+{
+	return bump->size;
+}
@@ -0,0 +1,199 @@
+#include <kzadhbat/collections/magazine.h>
+#include <kzadhbat/arch/riscv.h>
+#include <kzadhbat/fmtprint.h>
+
+errval_t magazine_init(struct magazineCache *cache, const char *name, struct magazine *magazines, size_t count,
+		       magazine_fill_func_t fill, magazine_drain_func_t drain, void *ctx)
+{
+	if (cache == NULL || magazines == NULL || fill == NULL || drain == NULL) {
+		return ERR_NULL_ARGUMENT;
+	}
+	if (count < MAGAZINE_PER_HART * MAGAZINE_MAX_HARTS) {
+		return ERR_MAGAZINE_TOO_FEW;
+	}
+
+	cache->name = name;
+	cache->fill = fill;
+	cache->drain = drain;
+	cache->ctx = ctx;
+	spinlock_init(&cache->depot_lock);
+	cache->full = NULL;
+	cache->empty = NULL;
+	cache->depot_gets = cache->depot_puts = 0;
+	cache->backend_fills = cache->backend_drains = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		magazines[i].rounds = 0;
+		magazines[i].next = NULL;
+	}
+	for (size_t i = 0; i < MAGAZINE_MAX_HARTS; i++) {
+		struct magazineHart *hart = &cache->harts[i];
+		hart->loaded = &magazines[MAGAZINE_PER_HART * i];
+		hart->previous = &magazines[MAGAZINE_PER_HART * i + 1];
+		hart->alloc_hits = hart->alloc_misses = 0;
+		hart->free_hits = hart->free_misses = 0;
+	}
+	for (size_t i = MAGAZINE_PER_HART * MAGAZINE_MAX_HARTS; i < count; i++) {
+		magazines[i].next = cache->empty;
+		cache->empty = &magazines[i];
+	}
+	return ERR_OK;
+}
+
+void *magazine_alloc(struct magazineCache *cache)
+{
+	u64 hartid = cpu_hartid();
+	if (hartid >= MAGAZINE_MAX_HARTS) {
+		void *object = NULL;
+		return cache->fill(cache->ctx, &object, 1) == 1 ? object : NULL;
+	}
+	struct magazineHart *hart = &cache->harts[hartid];
+
+	// Fast path, no shared state is touched
+	if (hart->loaded->rounds > 0) {
+		hart->alloc_hits++;
+		return hart->loaded->objects[--hart->loaded->rounds];
+	}
+	if (hart->previous->rounds > 0) {
+		struct magazine *tmp = hart->loaded;
+		hart->loaded = hart->previous;
+		hart->previous = tmp;
+		hart->alloc_hits++;
+		return hart->loaded->objects[--hart->loaded->rounds];
+	}
+	hart->alloc_misses++;
+
+	// Both magazines are empty, trade the previous one for a full magazine from the depot
+	spinlock_acquire(&cache->depot_lock);
+	if (cache->full != NULL) {
+		struct magazine *full = cache->full;
+		cache->full = full->next;
+		hart->previous->next = cache->empty;
+		cache->empty = hart->previous;
+		cache->depot_gets++;
+		spinlock_release(&cache->depot_lock);
+
+		hart->previous = hart->loaded;
+		hart->loaded = full;
+		return hart->loaded->objects[--hart->loaded->rounds];
+	}
+	cache->backend_fills++;
+	spinlock_release(&cache->depot_lock);
+
+	// The depot is dry as well, refill half a magazine from the backing allocator
+	hart->loaded->rounds = cache->fill(cache->ctx, hart->loaded->objects, MAGAZINE_ROUNDS / 2);
+	if (hart->loaded->rounds == 0) {
+		return NULL;
+	}
+	return hart->loaded->objects[--hart->loaded->rounds];
+}
+
+void magazine_free(struct magazineCache *cache, void *object)
+{
+	u64 hartid = cpu_hartid();
+	if (hartid >= MAGAZINE_MAX_HARTS) {
+		cache->drain(cache->ctx, &object, 1);
+		return;
+	}
+	struct magazineHart *hart = &cache->harts[hartid];
+
+	// Fast path, no shared state is touched
+	if (hart->loaded->rounds < MAGAZINE_ROUNDS) {
+		hart->free_hits++;
+		hart->loaded->objects[hart->loaded->rounds++] = object;
+		return;
+	}
+	if (hart->previous->rounds == 0) {
+		struct magazine *tmp = hart->loaded;
+		hart->loaded = hart->previous;
+		hart->previous = tmp;
+		hart->free_hits++;
+		hart->loaded->objects[hart->loaded->rounds++] = object;
+		return;
+	}
+	hart->free_misses++;
+
+	// Both magazines are full, trade the previous one for an empty magazine from the depot
+	spinlock_acquire(&cache->depot_lock);
+	if (cache->empty != NULL) {
+		struct magazine *empty = cache->empty;
+		cache->empty = empty->next;
+		hart->previous->next = cache->full;
+		cache->full = hart->previous;
+		cache->depot_puts++;
+		spinlock_release(&cache->depot_lock);
+
+		hart->previous = hart->loaded;
+		hart->loaded = empty;
+		hart->loaded->objects[hart->loaded->rounds++] = object;
+		return;
+	}
+	cache->backend_drains++;
+	spinlock_release(&cache->depot_lock);
+
+	// The depot has no empty magazines left, drain half a magazine to the backing allocator
+	hart->loaded->rounds = MAGAZINE_ROUNDS / 2;
+	cache->drain(cache->ctx, &hart->loaded->objects[MAGAZINE_ROUNDS / 2], MAGAZINE_ROUNDS / 2);
+	hart->loaded->objects[hart->loaded->rounds++] = object;
+}
+
+size_t magazine_reclaim(struct magazineCache *cache)
+{
+	size_t reclaimed = 0;
+
+	spinlock_acquire(&cache->depot_lock);
+	while (cache->full != NULL) {
+		struct magazine *full = cache->full;
+		cache->full = full->next;
+		cache->drain(cache->ctx, full->objects, full->rounds);
+		reclaimed += full->rounds;
+		full->rounds = 0;
+		full->next = cache->empty;
+		cache->empty = full;
+		cache->backend_drains++;
+	}
+	spinlock_release(&cache->depot_lock);
+
+	u64 hartid = cpu_hartid();
+	if (hartid < MAGAZINE_MAX_HARTS) {
+		struct magazineHart *hart = &cache->harts[hartid];
+		struct magazine *magazines[] = { hart->loaded, hart->previous };
+		for (size_t i = 0; i < MAGAZINE_PER_HART; i++) {
+			cache->drain(cache->ctx, magazines[i]->objects, magazines[i]->rounds);
+			reclaimed += magazines[i]->rounds;
+			magazines[i]->rounds = 0;
+		}
+	}
+	return reclaimed;
+}
+
+size_t magazine_cached(struct magazineCache *cache)
+{
+	size_t cached = 0;
+	for (size_t i = 0; i < MAGAZINE_MAX_HARTS; i++) {
+		cached += cache->harts[i].loaded->rounds + cache->harts[i].previous->rounds;
+	}
+	spinlock_acquire(&cache->depot_lock);
+	for (struct magazine *m = cache->full; m != NULL; m = m->next) {
+		cached += m->rounds;
+	}
+	spinlock_release(&cache->depot_lock);
+	return cached;
+}
+
+void magazine_print_stats(struct magazineCache *cache)
+{
+	println("[magazine] %s: depot gets: %d, depot puts: %d, backend fills: %d, backend drains: %d", cache->name,
+		cache->depot_gets, cache->depot_puts, cache->backend_fills, cache->backend_drains);
+	for (size_t i = 0; i < MAGAZINE_MAX_HARTS; i++) {
+		struct magazineHart *hart = &cache->harts[i];
+		u64 allocs = hart->alloc_hits + hart->alloc_misses;
+		u64 frees = hart->free_hits + hart->free_misses;
+		if (allocs == 0 && frees == 0) {
+			continue;
+		}
+		println("\t* hart %d: alloc hits %d/%d (%d%%), free hits %d/%d (%d%%)", i, hart->alloc_hits, allocs,
+			allocs ? hart->alloc_hits * 100 / allocs : 0, hart->free_hits, frees,
+			frees ? hart->free_hits * 100 / frees : 0);
+	}
+}
@@ -0,0 +1,121 @@
+#include <kzadhbat/collections/slab_cache.h>
+#include <kzadhbat/fmtprint.h>
+
+// Forward declarations
+size_t slab_cache_fill(void *ctx, void **blocks, size_t count);
+void slab_cache_drain(void *ctx, void **blocks, size_t count);
+
+errval_t slab_cache_init(struct slabCache *cache, const char *name, size_t blocksize, slab_object_func_t ctor,
+			 slab_object_func_t dtor, struct magazine *magazines, size_t count)
+{
+	errval_t err = err_new();
+	if (cache == NULL) {
+		return err_push(err, ERR_NULL_ARGUMENT);
+	}
+
+	cache->name = name;
+	cache->ctor = ctor;
+	cache->dtor = dtor;
+	spinlock_init(&cache->lock);
+	if (err_is_fail((err = slab_init(&cache->slabs, blocksize)))) {
+		return err;
+	}
+	return magazine_init(&cache->magazines, name, magazines, count, slab_cache_fill, slab_cache_drain, cache);
+}
+
+errval_t slab_cache_grow(struct slabCache *cache, void *buf, size_t len)
+{
+	spinlock_acquire(&cache->lock);
+	errval_t err = slab_grow(&cache->slabs, buf, len);
+	spinlock_release(&cache->lock);
+	return err;
+}
+
+/// Moves up to count blocks from the slab allocator into a hart's magazine, constructing them on the way.
+size_t slab_cache_fill(void *ctx, void **blocks, size_t count)
+{
+	struct slabCache *cache = ctx;
+	size_t filled = 0;
+	spinlock_acquire(&cache->lock);
+	while (filled < count && (blocks[filled] = slab_alloc(&cache->slabs)) != NULL) {
+		filled++;
+	}
+	spinlock_release(&cache->lock);
+	// Construct outside of the lock, other harts keep draining and filling meanwhile
+	if (cache->ctor != NULL) {
+		for (size_t i = 0; i < filled; i++) {
+			cache->ctor(blocks[i]);
+		}
+	}
+	return filled;
+}
+
+/// Returns the blocks of a hart's magazine to the slab allocator, destroying them on the way.
+void slab_cache_drain(void *ctx, void **blocks, size_t count)
+{
+	struct slabCache *cache = ctx;
+	if (cache->dtor != NULL) {
+		for (size_t i = 0; i < count; i++) {
+			cache->dtor(blocks[i]);
+		}
+	}
+	spinlock_acquire(&cache->lock);
+	for (size_t i = 0; i < count; i++) {
+		slab_free(&cache->slabs, blocks[i]);
+	}
+	spinlock_release(&cache->lock);
+}
+
+void *slab_cache_alloc(struct slabCache *cache)
+{
+	return magazine_alloc(&cache->magazines);
+}
+
+errval_t slab_cache_free(struct slabCache *cache, void *block)
+{
+	errval_t err = err_new();
+	if (cache == NULL || block == NULL) {
+		return err_push(err, ERR_NULL_ARGUMENT);
+	}
+
+	// Foreign blocks must not make it into the magazines, where nothing checks them anymore
+	struct slabRegion *region = (struct slabRegion *)((uintptr_t)block & ~(uintptr_t)(SLAB_REGION_ALIGN - 1));
+	if (region->magic != SLAB_REGION_MAGIC || region->slabs != &cache->slabs) {
+		return err_push(err, ERR_SLAB_FOREIGN_BLOCK);
+	}
+	magazine_free(&cache->magazines, block);
+	return err;
+}
+
+size_t slab_cache_reclaim(struct slabCache *cache)
+{
+	size_t reclaimed = magazine_reclaim(&cache->magazines);
+	spinlock_acquire(&cache->lock);
+	slab_reclaim(&cache->slabs);
+	spinlock_release(&cache->lock);
+	return reclaimed;
+}
+
+struct slabAllocator *slab_cache_slabs(struct slabCache *cache)
+{
+	return &cache->slabs;
+}
+
+void slab_cache_print_stats(struct slabCache *cache)
+{
+	u64 hits = 0;
+	u64 requests = 0;
+	for (size_t i = 0; i < MAGAZINE_MAX_HARTS; i++) {
+		struct magazineHart *hart = &cache->magazines.harts[i];
+		hits += hart->alloc_hits + hart->free_hits;
+		requests += hart->alloc_hits + hart->alloc_misses + hart->free_hits + hart->free_misses;
+	}
+	spinlock_acquire(&cache->lock);
+	u64 total = cache->slabs.total;
+	u64 free = cache->slabs.free;
+	spinlock_release(&cache->lock);
+	println("[slab_cache] %s: %d byte blocks, %d/%d taken from the slabs, magazine hits %d/%d (%d%%), %d blocks cached",
+		cache->name, cache->slabs.blocksize, total - free, total, hits, requests,
+		requests ? hits * 100 / requests : 0, magazine_cached(&cache->magazines));
+	magazine_print_stats(&cache->magazines);
+}
@@ -10,6 +10,13 @@ static const char *grouper_error_str[] = {
 	[ERR_SLAB_REGION_TOO_SMALL] = "Slab region is too small to allocate a block from.",
 	[ERR_SLAB_FOREIGN_BLOCK] = "Slab block being returned is not managed by this allocator.",
 
+	// Magazine cache errors:
+	[ERR_MAGAZINE_TOO_FEW] = "Magazine cache needs at least two magazines for every hart.",
+
+	// Hash map errors:
+	[ERR_HASHMAP_OUT_OF_MEMORY] = "Hash map failed to allocate a table.",
+	[ERR_HASHMAP_PROBE_TOO_LONG] = "Hash map probe too long, the hash function maps too many keys alike.",
+
 	// Physical memory manager errors:
 	[ERR_PMM_INIT] = "Physical memory manager initialization failed.",
 	[ERR_PMM_SLAB_ALLOC_FAILED] = "Physical memory manager slab allocator failed to allocate a block.",
@@ -23,6 +30,17 @@ static const char *grouper_error_str[] = {
 		"Physical memory manager does not have enough free memory to satisfy the allocation request.",
 	[ERR_PMM_REGION_LIST_EMPTY] = "Physical memory manager region list is empty. No regions are managed.",
 	[ERR_PMM_REGION_LIST_FULL] = "Physical memory manager region list is full. No more regions can be added.",
+	[ERR_PMM_REGION_ALLOCATED_FROM] =
+		"Attempted to remove a region from the physical memory manager that has memory allocated from it.",
+	[ERR_PMM_REGION_NOT_MANAGED] = "Attempted to remove a region that is not managed by the physical memory manager.",
+	[ERR_PMM_INVALID_FREE] =
+		"Attempted to free an address that is not the base of a block allocated by the physical memory manager.",
+	[ERR_PMM_BAD_HUGE_ORDER] = "Huge frames must be of order PMM_HUGE_ORDER_MEGA or PMM_HUGE_ORDER_GIGA.",
+	[ERR_PMM_CANNOT_EXTEND] = "The frames following the allocation are not free, it cannot be extended in place.",
+
+	// Kernel heap errors
+	[ERR_KMALLOC_INIT] = "Kernel heap initialization failed.",
+	[ERR_KMALLOC_INVALID_FREE] = "Attempted to kfree a pointer that was not handed out by kmalloc.",
 
 	// Paging errors
 	[ERR_PAGING_UNALIGNED_ADDRESS] =
@@ -1,57 +1,416 @@
 #include <kzadhbat/libc/string.h>
+#include <kzadhbat/types/numeric_types.h>
+#include <kzadhbat/bitmacros.h>
+
+#ifdef ENABLE_RVV
+// The RVV implementations, see rvv.S
+void *memcpy_rvv(void *dest, const void *src, size_t count);
+void *memset_rvv(void *dest, int ch, size_t count);
+int memcmp_rvv(const void *lhs, const void *rhs, size_t count);
+size_t strlen_rvv(const char *str);
+int strcmp_rvv(const char *lhs, const char *rhs);
+int strncmp_rvv(const char *lhs, const char *rhs, size_t num);
+
+/// Set once at boot, the branch on it is as good as free next to an indirect call
+bool libc_vector = false;
+#define LIBC_DISPATCH(name, ...)                          \
+	do {                                              \
+		if (libc_vector) {                        \
+			return name##_rvv(__VA_ARGS__);   \
+		}                                         \
+	} while (0)
+#else
+#define LIBC_DISPATCH(name, ...)
+#endif
+
+void libc_use_vector(bool enable)
+{
+#ifdef ENABLE_RVV
+	libc_vector = enable;
+#else
+	(void)enable;
+#endif
+}
+
+// The routines below work a 64-bit word at a time once the destination is aligned, with the bulk of the work done
+// in loops unrolled to a cache line. Sources that are misaligned relative to the destination are read as aligned
+// words and shifted into place, as misaligned loads may trap to (slow) firmware emulation on RISC-V. Reading whole
+// aligned words may touch bytes just outside of the source, but never another page. The functions are excluded from
+// loop distribution, which would otherwise turn their loops back into calls to themselves.
+
+/// A word that may alias any other type.
+typedef u64 __attribute__((may_alias)) word_t;
+
+#define WORD_SIZE sizeof(word_t)
+#define WORD_MASK (WORD_SIZE - 1)
+/// Words moved per iteration of the unrolled loops, a cache line.
+#define UNROLL 8
+/// Below this size the head and tail handling costs more than it saves.
+#define SMALL_COUNT 16
+
+#define LIBC_FUNCTION __attribute__((optimize("no-tree-loop-distribute-patterns")))
+
+#define WORD_ONES 0x0101010101010101ull
+#define WORD_HIGHS 0x8080808080808080ull
+
+/// Returns a word with the high bit set in every byte of w that is zero. Bytes above the first zero byte may be
+/// flagged spuriously through the borrow, the lowest flagged byte is always exact.
+static inline word_t word_zero_bytes(word_t w)
+{
+	return (w - WORD_ONES) & ~w & WORD_HIGHS;
+}
+
+/// Returns the index of the lowest byte flagged in zeros (non-zero). Without Zbb its isolated bit is multiplied into
+/// a table of byte indices, which beats the portable bit_ctz.
+static inline size_t word_first_byte(word_t zeros)
+{
+#ifdef __riscv_zbb
+	return bit_ctz(zeros) / 8;
+#else
+	return (((zeros & -zeros) >> 7) * 0x0001020304050607ull) >> 56;
+#endif
+}
+
+/// Returns a word with the bytes below offset set, which keeps them from matching anything in the word_zero_bytes
+/// of an aligned word read from in front of a string.
+static inline word_t word_head_mask(size_t offset)
+{
+	return (1ull << (offset * 8)) - 1;
+}
 
 // String Manipulation
 
 // String Examination
+//
+// The strings are scanned an aligned word at a time. The words may extend past the end of the string, or of the
+// count given to strnlen and memchr, but an aligned word never straddles a page, so the over-read can not fault.
 
-size_t strlen(const char *str)
+/// Returns the index of the first byte equal to byte in the max bytes at s, or max if there is none.
+LIBC_FUNCTION size_t mem_find_byte(const unsigned char *s, u8 byte, size_t max)
 {
-	const char *end = str;
-	while (*end != '\0')
-		++end;
-	return end - str;
+	if (max == 0) {
+		return 0;
+	}
+	word_t pattern = byte * WORD_ONES;
+	size_t offset = (uintptr_t)s & WORD_MASK;
+	const word_t *w = (const word_t *)(s - offset);
+	word_t found = word_zero_bytes((*w ^ pattern) | word_head_mask(offset));
+	size_t scanned = WORD_SIZE - offset;
+	while (found == 0 && scanned < max) {
+		found = word_zero_bytes(*++w ^ pattern);
+		scanned += WORD_SIZE;
+	}
+	if (found == 0) {
+		return max;
+	}
+	size_t index = (const unsigned char *)w + word_first_byte(found) - s;
+	return index < max ? index : max;
 }
 
-int strcmp(const char *lhs, const char *rhs)
+LIBC_FUNCTION size_t strlen(const char *str)
 {
-	while (*lhs && (*lhs == *rhs)) {
-		lhs++;
-		rhs++;
+	LIBC_DISPATCH(strlen, str);
+	size_t offset = (uintptr_t)str & WORD_MASK;
+	const word_t *w = (const word_t *)(str - offset);
+	word_t zeros = word_zero_bytes(*w | word_head_mask(offset));
+	while (zeros == 0) {
+		zeros = word_zero_bytes(*++w);
 	}
-	return *(unsigned char *)lhs - *(unsigned char *)rhs;
+	return (const char *)w + word_first_byte(zeros) - str;
 }
 
-int strncmp(const char *lhs, const char *rhs, size_t num)
+size_t strnlen(const char *str, size_t max)
+{
+	return mem_find_byte((const unsigned char *)str, 0, max);
+}
+
+/// Returns the difference of the first bytes of lhs and rhs that differ or are the end of lhs, one of which exists.
+static inline int word_compare(word_t lhs, word_t rhs)
 {
-	while (num && *lhs && (*lhs == *rhs)) {
-		lhs++;
-		rhs++;
-		num--;
+	word_t diff = lhs ^ rhs;
+	// Exact unlike word_zero_bytes, the sum can not carry into the next byte
+	word_t differing = (((diff & ~WORD_HIGHS) + ~WORD_HIGHS) | diff) & WORD_HIGHS;
+	size_t shift = word_first_byte(differing | word_zero_bytes(lhs)) * 8;
+	return (int)((lhs >> shift) & 0xff) - (int)((rhs >> shift) & 0xff);
+}
+
+/// Compares at most num bytes of lhs and rhs. Once lhs is aligned rhs is read as aligned words as well, which are
+/// shifted into place when it is misaligned. The next word of rhs is only read while its string continues into it,
+/// otherwise the missing bytes are shifted in as zeros past the end of rhs.
+LIBC_FUNCTION int str_compare(const unsigned char *l, const unsigned char *r, size_t num)
+{
+	// Most comparisons, like the lookups of a name in a list, are decided by the first byte
+	if (num == 0 || *l != *r || *l == '\0') {
+		return num == 0 ? 0 : *l - *r;
 	}
-	if (num == 0) {
-		return 0; // Strings are equal up to num characters
+
+	// The bytes up to the alignment of lhs are compared as one partial word
+	size_t head = (uintptr_t)l & WORD_MASK;
+	if (head != 0 && num >= WORD_SIZE) {
+		size_t offset = (uintptr_t)r & WORD_MASK;
+		const word_t *rw = (const word_t *)(r - offset);
+		word_t lword = *(const word_t *)(l - head) >> (head * 8);
+		word_t rword = *rw >> (offset * 8);
+		if (offset > head && word_zero_bytes(*rw | word_head_mask(offset)) == 0) {
+			rword |= rw[1] << ((WORD_SIZE - offset) * 8);
+		}
+		word_t valid = word_head_mask(WORD_SIZE - head);
+		if (((lword ^ rword) & valid) != 0 || word_zero_bytes(lword | ~valid) != 0) {
+			return word_compare(lword, rword);
+		}
+		l += WORD_SIZE - head;
+		r += WORD_SIZE - head;
+		num -= WORD_SIZE - head;
 	}
-	return *(unsigned char *)lhs - *(unsigned char *)rhs;
+	for (; num > 0 && ((uintptr_t)l & WORD_MASK); num--, l++, r++) {
+		if (*l != *r || *l == '\0') {
+			return *l - *r;
+		}
+	}
+
+	const word_t *lw = (const word_t *)l;
+	size_t offset = (uintptr_t)r & WORD_MASK;
+	if (offset == 0) {
+		const word_t *rw = (const word_t *)r;
+		for (; num >= WORD_SIZE; num -= WORD_SIZE, lw++, rw++) {
+			if (*lw != *rw || word_zero_bytes(*lw) != 0) {
+				return word_compare(*lw, *rw);
+			}
+		}
+	} else {
+		const word_t *rw = (const word_t *)(r - offset);
+		u32 right = offset * 8;
+		u32 left = 64 - right;
+		word_t prev = *rw;
+		for (; num >= WORD_SIZE; num -= WORD_SIZE, lw++) {
+			word_t rword = prev >> right;
+			if (word_zero_bytes(prev | word_head_mask(offset)) == 0) {
+				prev = *++rw;
+				rword |= prev << left;
+			}
+			if (*lw != rword || word_zero_bytes(*lw) != 0) {
+				return word_compare(*lw, rword);
+			}
+		}
+	}
+	r += (const unsigned char *)lw - l;
+	l = (const unsigned char *)lw;
+
+	for (; num > 0; num--, l++, r++) {
+		if (*l != *r || *l == '\0') {
+			return *l - *r;
+		}
+	}
+	return 0;
+}
+
+int strcmp(const char *lhs, const char *rhs)
+{
+	LIBC_DISPATCH(strcmp, lhs, rhs);
+	return str_compare((const unsigned char *)lhs, (const unsigned char *)rhs, (size_t)-1);
 }
 
+int strncmp(const char *lhs, const char *rhs, size_t num)
+{
+	LIBC_DISPATCH(strncmp, lhs, rhs, num);
+	return str_compare((const unsigned char *)lhs, (const unsigned char *)rhs, num);
+}
 
 // Character Array Manipulation
 
-void *memset(void *dest, int ch, size_t count)
+void *memchr(const void *ptr, int ch, size_t count)
 {
-	unsigned char *dst = (unsigned char *)dest;
-	for (size_t i = 0; i < count; i++) {
-		dst[i] = (unsigned char)ch;
+	const unsigned char *p = (const unsigned char *)ptr;
+	size_t index = mem_find_byte(p, (u8)ch, count);
+	return index < count ? (void *)(p + index) : NULL;
+}
+
+LIBC_FUNCTION void *memset(void *dest, int ch, size_t count)
+{
+	LIBC_DISPATCH(memset, dest, ch, count);
+	unsigned char *d = (unsigned char *)dest;
+	if (count < SMALL_COUNT) {
+		while (count--) {
+			*d++ = (unsigned char)ch;
+		}
+		return dest;
+	}
+
+	// Head bytes up to word alignment
+	while ((uintptr_t)d & WORD_MASK) {
+		*d++ = (unsigned char)ch;
+		count--;
+	}
+
+	word_t pattern = (u8)ch * 0x0101010101010101ull;
+	word_t *w = (word_t *)d;
+	for (; count >= UNROLL * WORD_SIZE; count -= UNROLL * WORD_SIZE, w += UNROLL) {
+		w[0] = pattern;
+		w[1] = pattern;
+		w[2] = pattern;
+		w[3] = pattern;
+		w[4] = pattern;
+		w[5] = pattern;
+		w[6] = pattern;
+		w[7] = pattern;
+	}
+	for (; count >= WORD_SIZE; count -= WORD_SIZE) {
+		*w++ = pattern;
+	}
+
+	d = (unsigned char *)w;
+	while (count--) {
+		*d++ = (unsigned char)ch;
 	}
 	return dest;
 }
 
+/// Copies count bytes front to back. Safe for overlapping ranges as long as dest is below src.
+LIBC_FUNCTION void mem_copy_forward(unsigned char *d, const unsigned char *s, size_t count)
+{
+	if (count < SMALL_COUNT) {
+		while (count--) {
+			*d++ = *s++;
+		}
+		return;
+	}
+
+	// Head bytes up to the destination's word alignment
+	while ((uintptr_t)d & WORD_MASK) {
+		*d++ = *s++;
+		count--;
+	}
+
+	word_t *dw = (word_t *)d;
+	size_t offset = (uintptr_t)s & WORD_MASK;
+	if (offset == 0) {
+		const word_t *sw = (const word_t *)s;
+		for (; count >= UNROLL * WORD_SIZE; count -= UNROLL * WORD_SIZE, dw += UNROLL, sw += UNROLL) {
+			word_t w0 = sw[0], w1 = sw[1], w2 = sw[2], w3 = sw[3];
+			word_t w4 = sw[4], w5 = sw[5], w6 = sw[6], w7 = sw[7];
+			dw[0] = w0;
+			dw[1] = w1;
+			dw[2] = w2;
+			dw[3] = w3;
+			dw[4] = w4;
+			dw[5] = w5;
+			dw[6] = w6;
+			dw[7] = w7;
+		}
+		for (; count >= WORD_SIZE; count -= WORD_SIZE) {
+			*dw++ = *sw++;
+		}
+		s = (const unsigned char *)sw;
+	} else {
+		// Every destination word is stitched together from two aligned source words
+		const word_t *sw = (const word_t *)(s - offset);
+		u32 right = offset * 8;
+		u32 left = 64 - right;
+		word_t prev = *sw++;
+		for (; count >= WORD_SIZE; count -= WORD_SIZE) {
+			word_t next = *sw++;
+			*dw++ = (prev >> right) | (next << left);
+			prev = next;
+		}
+		s = (const unsigned char *)sw - WORD_SIZE + offset;
+	}
+
+	d = (unsigned char *)dw;
+	while (count--) {
+		*d++ = *s++;
+	}
+}
+
+/// Copies count bytes back to front. Safe for overlapping ranges as long as dest is above src.
+LIBC_FUNCTION void mem_copy_backward(unsigned char *d, const unsigned char *s, size_t count)
+{
+	d += count;
+	s += count;
+	// Relatively misaligned ranges are rare for overlapping moves, those go a byte at a time
+	if (count < SMALL_COUNT || (((uintptr_t)d ^ (uintptr_t)s) & WORD_MASK) != 0) {
+		while (count--) {
+			*--d = *--s;
+		}
+		return;
+	}
+
+	while ((uintptr_t)d & WORD_MASK) {
+		*--d = *--s;
+		count--;
+	}
+	word_t *dw = (word_t *)d;
+	const word_t *sw = (const word_t *)s;
+	for (; count >= UNROLL * WORD_SIZE; count -= UNROLL * WORD_SIZE) {
+		dw -= UNROLL;
+		sw -= UNROLL;
+		word_t w7 = sw[7], w6 = sw[6], w5 = sw[5], w4 = sw[4];
+		word_t w3 = sw[3], w2 = sw[2], w1 = sw[1], w0 = sw[0];
+		dw[7] = w7;
+		dw[6] = w6;
+		dw[5] = w5;
+		dw[4] = w4;
+		dw[3] = w3;
+		dw[2] = w2;
+		dw[1] = w1;
+		dw[0] = w0;
+	}
+	for (; count >= WORD_SIZE; count -= WORD_SIZE) {
+		*--dw = *--sw;
+	}
+	d = (unsigned char *)dw;
+	s = (const unsigned char *)sw;
+	while (count--) {
+		*--d = *--s;
+	}
+}
+
 void *memcpy(void *dest, const void *src, size_t count)
+{
+	LIBC_DISPATCH(memcpy, dest, src, count);
+	mem_copy_forward((unsigned char *)dest, (const unsigned char *)src, count);
+	return dest;
+}
+
+void *memmove(void *dest, const void *src, size_t count)
 {
 	unsigned char *d = (unsigned char *)dest;
 	const unsigned char *s = (const unsigned char *)src;
-	for (size_t i = 0; i < count; i++) {
-		d[i] = s[i];
+	if (d <= s || d >= s + count) {
+		mem_copy_forward(d, s, count);
+	} else {
+		mem_copy_backward(d, s, count);
 	}
 	return dest;
-}
\ No newline at end of file
+}
+
+LIBC_FUNCTION int memcmp(const void *lhs, const void *rhs, size_t count)
+{
+	LIBC_DISPATCH(memcmp, lhs, rhs, count);
+	const unsigned char *l = (const unsigned char *)lhs;
+	const unsigned char *r = (const unsigned char *)rhs;
+
+	// Skip over equal words while both sides can be read a word at a time, the bytes of the first differing word
+	// are compared one by one below to get the sign right
+	if ((((uintptr_t)l ^ (uintptr_t)r) & WORD_MASK) == 0) {
+		while (count > 0 && ((uintptr_t)l & WORD_MASK)) {
+			if (*l != *r) {
+				return *l - *r;
+			}
+			l++;
+			r++;
+			count--;
+		}
+		while (count >= WORD_SIZE && *(const word_t *)l == *(const word_t *)r) {
+			l += WORD_SIZE;
+			r += WORD_SIZE;
+			count -= WORD_SIZE;
+		}
+	}
+
+	for (; count > 0; count--, l++, r++) {
+		if (*l != *r) {
+			return *l - *r;
+		}
+	}
+	return 0;
+}
@@ -5,6 +5,37 @@ struct slabBlock {
 	struct slabBlock *next;
 };
 
+/// Returns the list a region belongs on given its free count.
+struct slabRegion **slab_list_of(struct slabAllocator *slabs, struct slabRegion *region)
+{
+	if (region->free == 0) {
+		return &slabs->full;
+	}
+	return region->free == region->total ? &slabs->empty : &slabs->partial;
+}
+
+void slab_list_push(struct slabRegion **list, struct slabRegion *region)
+{
+	region->prev = NULL;
+	region->next = *list;
+	if (region->next != NULL) {
+		region->next->prev = region;
+	}
+	*list = region;
+}
+
+void slab_list_remove(struct slabRegion **list, struct slabRegion *region)
+{
+	if (region->prev != NULL) {
+		region->prev->next = region->next;
+	} else {
+		*list = region->next;
+	}
+	if (region->next != NULL) {
+		region->next->prev = region->prev;
+	}
+}
+
 errval_t slab_init(struct slabAllocator *slabs, size_t blocksize)
 {
 	errval_t err = err_new();
@@ -13,37 +44,84 @@ errval_t slab_init(struct slabAllocator *slabs, size_t blocksize)
 	}
 
 	slabs->blocksize = SLAB_BLOCKSIZE(blocksize);
-	slabs->regions = NULL;
+	slabs->partial = NULL;
+	slabs->full = NULL;
+	slabs->empty = NULL;
 	slabs->total = 0;
 	slabs->free = 0;
-	return err;
+	slabs->refill = NULL;
+	slabs->watermark = 0;
+	slabs->refilling = false;
+	slabs->release = NULL;
+	slabs->color = 0;
+	return slab_set_colors(slabs, 1);
 }
 
-errval_t slab_grow(struct slabAllocator *slabs, void *buf, size_t len)
+errval_t slab_set_colors(struct slabAllocator *slabs, size_t colors)
 {
 	errval_t err = err_new();
-	if (slabs == NULL || buf == NULL) {
+	if (slabs == NULL) {
 		return err_push(err, ERR_NULL_ARGUMENT);
 	}
 
-	// Check that the region is large enough to allocate at least a single block from.
-	if (len < SLAB_REGION_SIZE(1, slabs->blocksize)) {
+	size_t space = SLAB_REGION_ALIGN - sizeof(struct slabRegion);
+	size_t reserved = colors > 1 ? (colors - 1) * SLAB_COLOR_ALIGN : 0;
+	if (reserved >= space) {
 		return err_push(err, ERR_SLAB_REGION_TOO_SMALL);
 	}
+	slabs->region_blocks = (space - reserved) / slabs->blocksize;
+	size_t slack = space - slabs->region_blocks * slabs->blocksize;
+	slabs->max_color = slack - slack % SLAB_COLOR_ALIGN;
+	if (slabs->color > slabs->max_color) {
+		slabs->color = 0;
+	}
+	return err;
+}
+
+errval_t slab_set_refill(struct slabAllocator *slabs, slab_refill_func_t refill, size_t watermark)
+{
+	errval_t err = err_new();
+	if (slabs == NULL) {
+		return err_push(err, ERR_NULL_ARGUMENT);
+	}
+
+	slabs->refill = refill;
+	slabs->watermark = watermark;
+	return err;
+}
 
+errval_t slab_set_release(struct slabAllocator *slabs, slab_release_func_t release)
+{
+	errval_t err = err_new();
+	if (slabs == NULL) {
+		return err_push(err, ERR_NULL_ARGUMENT);
+	}
+
+	slabs->release = release;
+	return err;
+}
+
+/// Sets up a single SLAB_REGION_ALIGN sized and aligned slab region at buf and adds it to the allocator.
+void slab_add_region(struct slabAllocator *slabs, void *buf)
+{
 	// Setup slabRegion structure
 	struct slabRegion *region = buf;
-	len -= sizeof(struct slabRegion);
-	buf = (u8 *)buf - len;
+	region->magic = SLAB_REGION_MAGIC;
+	region->slabs = slabs;
+
+	// Start the blocks at the next color, so the first blocks of consecutive regions land in different cache sets
+	region->color = slabs->color;
+	slabs->color = slabs->color + SLAB_COLOR_ALIGN <= slabs->max_color ? slabs->color + SLAB_COLOR_ALIGN : 0;
+	buf = (u8 *)buf + sizeof(struct slabRegion) + region->color;
 
 	// Calculate the number of blocks in the buffer
-	region->free = region->total = len / slabs->blocksize;
+	region->free = region->total = slabs->region_blocks;
 	slabs->total += region->total;
 	slabs->free += region->free;
 
 	// Enqueue the slabBlocks in the region free list
 	struct slabBlock *block = region->blocks = buf;
-	for (size_t i = 0; i < region->total; i++) {
+	for (size_t i = 1; i < region->total; i++) {
 		buf = (u8 *)buf + slabs->blocksize;
 		block->next = buf;
 		block = buf;
@@ -51,30 +129,55 @@ errval_t slab_grow(struct slabAllocator *slabs, void *buf, size_t len)
 	block->next = NULL;
 
 	// Add the Region to the allocator
-	region->next = slabs->regions;
-	slabs->regions = region;
+	slab_list_push(&slabs->empty, region);
+}
+
+errval_t slab_grow(struct slabAllocator *slabs, void *buf, size_t len)
+{
+	errval_t err = err_new();
+	if (slabs == NULL || buf == NULL) {
+		return err_push(err, ERR_NULL_ARGUMENT);
+	}
+
+	// Check that the buffer holds at least one aligned region with a single block.
+	uintptr_t start = ((uintptr_t)buf + SLAB_REGION_ALIGN - 1) & ~(uintptr_t)(SLAB_REGION_ALIGN - 1);
+	uintptr_t end = ((uintptr_t)buf + len) & ~(uintptr_t)(SLAB_REGION_ALIGN - 1);
+	if (start >= end || slabs->region_blocks == 0) {
+		return err_push(err, ERR_SLAB_REGION_TOO_SMALL);
+	}
+
+	for (; start < end; start += SLAB_REGION_ALIGN) {
+		slab_add_region(slabs, (void *)start);
+	}
 	return err;
 }
 
 void *slab_alloc(struct slabAllocator *slabs)
 {
+	// Grow the allocator before it runs dry, the refill function allocates from the reserve if it needs to
+	if (slabs->refill != NULL && slabs->free <= slabs->watermark && !slabs->refilling) {
+		slabs->refilling = true;
+		slabs->refill(slabs);
+		slabs->refilling = false;
+	}
+
 	if (slabs->free == 0) {
 		return NULL;
 	}
 
-	// Find the first region that isn't fully allocated.
-	struct slabRegion *r;
-	for (r = slabs->regions; r != NULL && r->free == 0; r = r->next)
-		;
+	// Fill up the partial regions first, so the empty ones stay around for slab_reclaim
+	struct slabRegion *r = slabs->partial != NULL ? slabs->partial : slabs->empty;
 	if (r == NULL) {
 		return NULL;
 	}
+	slab_list_remove(slab_list_of(slabs, r), r);
 
 	// Dequeue the first block from the Region free list
 	struct slabBlock *sb = r->blocks;
 	r->blocks = sb->next;
 	r->free--;
 	slabs->free--;
+	slab_list_push(slab_list_of(slabs, r), r);
 
 	// Zero out the block before returning it
 #ifdef ZERO_OUT_SLAB_BLOCKS
@@ -91,25 +194,22 @@ errval_t slab_free(struct slabAllocator *slabs, void *block)
 	}
 	struct slabBlock *sb = (struct slabBlock *)block;
 
-	// Find the matching slabRegion
-	struct slabRegion *region;
-	size_t blocksize = blocksize;
-	for (region = slabs->regions; region != NULL; region = region->next) {
-		// Check if the block falls inside this slab
-		bool LOWER_BOUND = (uintptr_t)region < (uintptr_t)sb;
-		bool UPPER_BOUND = (uintptr_t)sb <
-				   (uintptr_t)region + sizeof(struct slabRegion) + region->total * slabs->blocksize;
-		if (LOWER_BOUND && UPPER_BOUND)
-			break;
-	}
-
-	if (region == NULL)
+	// The region header sits at the aligned base below the block, the magic and owner reject foreign blocks
+	struct slabRegion *region = (struct slabRegion *)((uintptr_t)sb & ~(uintptr_t)(SLAB_REGION_ALIGN - 1));
+	uintptr_t first = (uintptr_t)region + sizeof(struct slabRegion) + region->color;
+	uintptr_t offset = (uintptr_t)sb - first;
+	bool OWNED = region->magic == SLAB_REGION_MAGIC && region->slabs == slabs;
+	bool IN_BOUNDS = (uintptr_t)sb >= first && offset < region->total * slabs->blocksize;
+	if (!OWNED || !IN_BOUNDS || offset % slabs->blocksize != 0) {
 		return err_push(err, ERR_SLAB_FOREIGN_BLOCK);
+	}
 
+	slab_list_remove(slab_list_of(slabs, region), region);
 	sb->next = region->blocks;
 	region->blocks = sb;
 	region->free++;
 	slabs->free++;
+	slab_list_push(slab_list_of(slabs, region), region);
 	return err;
 }
 
@@ -117,3 +217,32 @@ size_t slab_freecount(struct slabAllocator *slabs)
 {
 	return slabs->free;
 }
+
+size_t slab_reclaim(struct slabAllocator *slabs)
+{
+	size_t released = 0;
+	struct slabRegion *kept = NULL;
+	while (slabs->release != NULL && slabs->empty != NULL && slabs->free - slabs->empty->total > slabs->watermark) {
+		// Take the region out before handing it back, the release function may allocate from the allocator
+		struct slabRegion *region = slabs->empty;
+		slab_list_remove(&slabs->empty, region);
+		slabs->total -= region->total;
+		slabs->free -= region->total;
+		region->magic = 0;
+		if (err_is_fail(slabs->release(slabs, region))) {
+			// Not ours to give back (a static buffer for instance), set it aside until the loop is done
+			region->magic = SLAB_REGION_MAGIC;
+			slab_list_push(&kept, region);
+		} else {
+			released++;
+		}
+	}
+	while (kept != NULL) {
+		struct slabRegion *region = kept;
+		slab_list_remove(&kept, region);
+		slabs->total += region->total;
+		slabs->free += region->total;
+		slab_list_push(&slabs->empty, region);
+	}
+	return released;
+}
@@ -0,0 +1,323 @@
+#include <octiron/bench.h>
+#include <octiron/pmm.h>
+#include <octiron/kmalloc.h>
+
+#include <kzadhbat/arch/riscv.h>
+#include <kzadhbat/collections/slab.h>
+#include <kzadhbat/collections/hashmap.h>
+#include <kzadhbat/fmtprint.h>
+#include <kzadhbat/libc/string.h>
+#include <kzadhbat/types/error.h>
+
+#ifdef ENABLE_BENCHMARKS
+
+/// Slab regions chased through, enough for their first objects to overflow any L1 set.
+#define BENCH_SLAB_REGIONS 64
+/// Laps around the chain of objects per measurement.
+#define BENCH_SLAB_LAPS 1000
+/// Colors handed to the colored slab allocator, spreading the objects over 8 cache sets.
+#define BENCH_SLAB_COLORS 8
+
+/// A pmmBlock sized object, linked into the chain that is chased.
+struct benchObject {
+	struct benchObject *next;
+	u8 payload[40];
+};
+SASSERT(sizeof(struct benchObject) == 48, "benchObject must be as wide as a pmmBlock");
+
+/// Chases the chain starting at head for laps laps, returning the cycles taken per hop.
+u64 bench_chase(struct benchObject *head, size_t hops, size_t laps)
+{
+	struct benchObject *object = head;
+	u64 start = cpu_cycles();
+	for (size_t i = 0; i < hops * laps; i++) {
+		object = object->next;
+	}
+	u64 cycles = cpu_cycles() - start;
+	// Keep the compiler from dropping the chase
+	asm volatile("" : : "r"(object));
+	return cycles / (hops * laps);
+}
+
+/// Links the first object of every slab region in pages into a chain in a scattered order, so the hardware prefetcher
+/// can't follow along, and returns its head.
+struct benchObject *bench_slab_chain(u8 **pages)
+{
+	struct benchObject *objects[BENCH_SLAB_REGIONS];
+	for (size_t i = 0; i < BENCH_SLAB_REGIONS; i++) {
+		struct slabRegion *region = (struct slabRegion *)pages[i];
+		objects[i] = (struct benchObject *)(pages[i] + sizeof(struct slabRegion) + region->color);
+	}
+	// 37 is coprime with the region count, so stepping by it visits every object once
+	for (size_t i = 0; i < BENCH_SLAB_REGIONS; i++) {
+		objects[(i * 37) % BENCH_SLAB_REGIONS]->next = objects[((i + 1) * 37) % BENCH_SLAB_REGIONS];
+	}
+	return objects[0];
+}
+
+void bench_slab_coloring(void)
+{
+	u8 *pages[BENCH_SLAB_REGIONS];
+	size_t colors[] = { 1, BENCH_SLAB_COLORS };
+	for (size_t c = 0; c < 2; c++) {
+		errval_t err = pmm_alloc_batch(BENCH_SLAB_REGIONS, pages);
+		if (err_is_fail(err)) {
+			println("[bench_slab_coloring] Failed to allocate the slab regions: %s", err_str(err));
+			return;
+		}
+		struct slabAllocator slabs;
+		slab_init(&slabs, sizeof(struct benchObject));
+		slab_set_colors(&slabs, colors[c]);
+		for (size_t i = 0; i < BENCH_SLAB_REGIONS; i++) {
+			slab_grow(&slabs, pages[i], BASE_PAGE_SIZE);
+		}
+
+		struct benchObject *head = bench_slab_chain(pages);
+		// The first lap warms up the TLB and whatever fits into the caches
+		bench_chase(head, BENCH_SLAB_REGIONS, 1);
+		u64 cycles = bench_chase(head, BENCH_SLAB_REGIONS, BENCH_SLAB_LAPS);
+		println("[bench_slab_coloring] %d colors (%d blocks per region): %d cycles per hop", slabs.max_color /
+			SLAB_COLOR_ALIGN + 1, slabs.region_blocks, cycles);
+
+		pmm_free_batch(BENCH_SLAB_REGIONS, pages);
+	}
+}
+
+/// Keys inserted into the benchmarked hash map.
+#define BENCH_HASHMAP_KEYS 4096
+/// Keys looked up by the linear scan it is compared against, a scan over all of them would take too long.
+#define BENCH_HASHMAP_SCANNED 256
+
+DEFINE_HASHMAP(u64, u64, hash_u64, HASHMAP_EQ);
+
+void *bench_hashmap_alloc(void *ctx, size_t size)
+{
+	(void)ctx;
+	return kmalloc(size);
+}
+
+void bench_hashmap_free(void *ctx, void *ptr)
+{
+	(void)ctx;
+	kfree(ptr);
+}
+
+/// The i-th key, frame addresses in a scattered order like the ones a PFN keyed map sees.
+u64 bench_hashmap_key(size_t i)
+{
+	return (u64)((i * 2654435761u) % (BENCH_HASHMAP_KEYS * 4)) * BASE_PAGE_SIZE;
+}
+
+void bench_hashmap(void)
+{
+	HASHMAP(u64, u64) map;
+	errval_t err = HASHMAP_FN(u64, u64, init)(&map, 0, bench_hashmap_alloc, bench_hashmap_free, NULL);
+	if (err_is_fail(err)) {
+		println("[bench_hashmap] Failed to create the map: %s", err_str(err));
+		return;
+	}
+
+	// Starting from an empty map, so the inserts include every incremental resize
+	u64 start = cpu_cycles();
+	for (size_t i = 0; i < BENCH_HASHMAP_KEYS; i++) {
+		if (err_is_fail(HASHMAP_FN(u64, u64, insert)(&map, bench_hashmap_key(i), i))) {
+			println("[bench_hashmap] Insert failed.");
+			HASHMAP_FN(u64, u64, destroy)(&map);
+			return;
+		}
+	}
+	u64 insert = (cpu_cycles() - start) / BENCH_HASHMAP_KEYS;
+
+	u64 sum = 0;
+	start = cpu_cycles();
+	for (size_t i = 0; i < BENCH_HASHMAP_KEYS; i++) {
+		sum += *HASHMAP_FN(u64, u64, get)(&map, bench_hashmap_key(i));
+	}
+	u64 hit = (cpu_cycles() - start) / BENCH_HASHMAP_KEYS;
+
+	// Unaligned addresses are never keys
+	start = cpu_cycles();
+	for (size_t i = 0; i < BENCH_HASHMAP_KEYS; i++) {
+		sum += HASHMAP_FN(u64, u64, get)(&map, bench_hashmap_key(i) + 1) != NULL;
+	}
+	u64 miss = (cpu_cycles() - start) / BENCH_HASHMAP_KEYS;
+
+	// What the lookups cost today, scanning the entries one by one
+	HASHMAP_ENTRY(u64, u64) *entries = kmalloc(BENCH_HASHMAP_KEYS * sizeof(*entries));
+	u64 scan = 0;
+	if (entries != NULL) {
+		for (size_t i = 0; i < BENCH_HASHMAP_KEYS; i++) {
+			entries[i].key = bench_hashmap_key(i);
+			entries[i].value = i;
+		}
+		start = cpu_cycles();
+		for (size_t i = 0; i < BENCH_HASHMAP_SCANNED; i++) {
+			u64 key = bench_hashmap_key(i * (BENCH_HASHMAP_KEYS / BENCH_HASHMAP_SCANNED));
+			for (size_t j = 0; j < BENCH_HASHMAP_KEYS; j++) {
+				if (entries[j].key == key) {
+					sum += entries[j].value;
+					break;
+				}
+			}
+		}
+		scan = (cpu_cycles() - start) / BENCH_HASHMAP_SCANNED;
+		kfree(entries);
+	}
+
+	start = cpu_cycles();
+	for (size_t i = 0; i < BENCH_HASHMAP_KEYS; i++) {
+		HASHMAP_FN(u64, u64, remove)(&map, bench_hashmap_key(i));
+	}
+	u64 remove = (cpu_cycles() - start) / BENCH_HASHMAP_KEYS;
+	asm volatile("" : : "r"(sum));
+
+	println("[bench_hashmap] %d keys, cycles per op: insert %d, hit %d, miss %d, remove %d, linear scan hit %d",
+		BENCH_HASHMAP_KEYS, insert, hit, miss, remove, scan);
+	HASHMAP_FN(u64, u64, destroy)(&map);
+}
+
+/// Largest size the memory routines are measured at.
+#define BENCH_MEMORY_MAX (2 * 1024 * 1024)
+/// Bytes moved per measurement, repeating the call as often as it takes (at least once).
+#define BENCH_MEMORY_BYTES (8 * 1024 * 1024)
+
+/// Returns the cycles a single call of op takes on size bytes, averaged over enough calls to move BENCH_MEMORY_BYTES.
+#define BENCH_MEMORY_MEASURE(op, size)                                              \
+	({                                                                          \
+		size_t reps = (size) < BENCH_MEMORY_BYTES ? BENCH_MEMORY_BYTES / (size) : 1; \
+		op;                                                                 \
+		u64 start = cpu_cycles();                                           \
+		for (size_t rep = 0; rep < reps; rep++) {                           \
+			op;                                                         \
+			asm volatile("" : : : "memory");                            \
+		}                                                                   \
+		(cpu_cycles() - start) / reps;                                      \
+	})
+
+void bench_memory(void)
+{
+	u8 *dst = NULL;
+	u8 *src = NULL;
+	errval_t err = pmm_alloc_flags(BENCH_MEMORY_MAX + BASE_PAGE_SIZE, BASE_PAGE_SIZE, PMM_ALLOC_NO_ZERO, &dst);
+	if (err_is_ok(err)) {
+		err = pmm_alloc_flags(BENCH_MEMORY_MAX + BASE_PAGE_SIZE, BASE_PAGE_SIZE, 0, &src);
+	}
+	if (err_is_fail(err)) {
+		println("[bench_memory] Failed to allocate the buffers: %s", err_str(err));
+		pmm_free(dst);
+		return;
+	}
+
+	println("[bench_memory] cycles per call: size, memset, memcpy, memcpy (misaligned source), memmove (overlapping)");
+	for (size_t size = 8; size <= BENCH_MEMORY_MAX; size *= 8) {
+		u64 set = BENCH_MEMORY_MEASURE(memset(dst, (int)size, size), size);
+		u64 copy = BENCH_MEMORY_MEASURE(memcpy(dst, src, size), size);
+		u64 misaligned = BENCH_MEMORY_MEASURE(memcpy(dst, src + 3, size), size);
+		u64 move = BENCH_MEMORY_MEASURE(memmove(dst + 8, dst, size), size);
+		println("[bench_memory] %d B: %d, %d, %d, %d", size, set, copy, misaligned, move);
+	}
+
+	pmm_free(src);
+	pmm_free(dst);
+}
+
+/// Property names as they show up in the QEMU virt device tree, in the order dtb_recursive_property_rewrite tests
+/// for the ones it knows about.
+const char *bench_string_names[] = {
+	"compatible", "model", "phandle", "status", "#address-cells", "#size-cells", "dma-coherent", "device_type",
+	"reg", "ranges", "dma-ranges", "interrupt-controller", "riscv,isa-extensions", "riscv,cboz-block-size",
+	"timebase-frequency", "interrupts-extended",
+};
+#define BENCH_STRING_COUNT (sizeof(bench_string_names) / sizeof(bench_string_names[0]))
+/// Passes over the names per measurement.
+#define BENCH_STRING_LAPS 1000
+
+/// The byte at a time strlen the SWAR one replaced, kept as the baseline.
+__attribute__((noinline, optimize("no-tree-loop-distribute-patterns"))) size_t bench_strlen_bytes(const char *str)
+{
+	const char *end = str;
+	while (*end != '\0')
+		++end;
+	return end - str;
+}
+
+/// The byte at a time strcmp the SWAR one replaced, kept as the baseline.
+__attribute__((noinline)) int bench_strcmp_bytes(const char *lhs, const char *rhs)
+{
+	while (*lhs && (*lhs == *rhs)) {
+		lhs++;
+		rhs++;
+	}
+	return *(unsigned char *)lhs - *(unsigned char *)rhs;
+}
+
+/// Returns the cycles per call of strlen_fn over the names in packed.
+#define BENCH_STRING_STRLEN(strlen_fn, packed)                                              \
+	({                                                                                  \
+		size_t total = 0;                                                           \
+		u64 start = cpu_cycles();                                                   \
+		for (size_t lap = 0; lap < BENCH_STRING_LAPS; lap++) {                      \
+			for (const char *name = (packed); *name != '\0'; name += strlen_fn(name) + 1) { \
+				total++;                                                    \
+			}                                                                   \
+		}                                                                           \
+		(cpu_cycles() - start) / total;                                             \
+	})
+
+/// Returns the cycles per call of strcmp_fn, looking up every name in packed by comparing it against the names in
+/// turn, the way the device tree picks the rewrite for a property.
+#define BENCH_STRING_STRCMP(strcmp_fn, packed)                                                    \
+	({                                                                                        \
+		size_t total = 0;                                                                 \
+		u64 start = cpu_cycles();                                                         \
+		for (size_t lap = 0; lap < BENCH_STRING_LAPS; lap++) {                            \
+			for (const char *name = (packed); *name != '\0'; name += bench_strlen_bytes(name) + 1) { \
+				for (size_t i = 0; i < BENCH_STRING_COUNT; i++) {                 \
+					total++;                                                  \
+					if (strcmp_fn(name, bench_string_names[i]) == 0) {        \
+						break;                                            \
+					}                                                         \
+				}                                                                 \
+			}                                                                         \
+		}                                                                                 \
+		(cpu_cycles() - start) / total;                                                   \
+	})
+
+void bench_strings(void)
+{
+	// The names are packed back to back like in the strings block of a blob, leaving them at every alignment
+	size_t size = 1;
+	for (size_t i = 0; i < BENCH_STRING_COUNT; i++) {
+		size += strlen(bench_string_names[i]) + 1;
+	}
+	char *packed = kmalloc(size);
+	if (packed == NULL) {
+		println("[bench_strings] Failed to allocate the names.");
+		return;
+	}
+	char *cursor = packed;
+	for (size_t i = 0; i < BENCH_STRING_COUNT; i++) {
+		size_t length = strlen(bench_string_names[i]) + 1;
+		memcpy(cursor, bench_string_names[i], length);
+		cursor += length;
+	}
+	*cursor = '\0';
+
+	u64 length_bytes = BENCH_STRING_STRLEN(bench_strlen_bytes, packed);
+	u64 length_words = BENCH_STRING_STRLEN(strlen, packed);
+	u64 compare_bytes = BENCH_STRING_STRCMP(bench_strcmp_bytes, packed);
+	u64 compare_words = BENCH_STRING_STRCMP(strcmp, packed);
+	println("[bench_strings] %d names, cycles per call (byte loop, libc): strlen %d, %d, strcmp %d, %d",
+		BENCH_STRING_COUNT, length_bytes, length_words, compare_bytes, compare_words);
+	kfree(packed);
+}
+
+void bench_run_all(void)
+{
+	bench_slab_coloring();
+	bench_hashmap();
+	bench_memory();
+	bench_strings();
+}
+
+#endif
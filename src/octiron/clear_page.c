@@ -0,0 +1,57 @@
+#include <octiron/clear_page.h>
+#include <octiron/devices/device_tree/device_tree.h>
+
+#include <kzadhbat/assert.h>
+#include <kzadhbat/arch/riscv.h>
+#include <kzadhbat/bitmacros.h>
+#include <kzadhbat/fmtprint.h>
+#include <kzadhbat/libc/string.h>
+
+/// Bytes zeroed by one cbo.zero, 0 while pages are cleared with stores.
+size_t clear_page_block = 0;
+
+/// Zeroes the cache block holding address, encoded by hand so the assembler needs no Zicboz support.
+static inline __attribute__((always_inline)) void cbo_zero(u8 *address)
+{
+	asm volatile(".insn i 0x0f, 2, x0, %0, 4" : : "r"(address) : "memory");
+}
+
+void clear_page_initialize(void)
+{
+	if (!dt_cpu_has_extension("zicboz")) {
+		println("[clear_page_initialize] The harts lack Zicboz, clearing pages with stores.");
+		return;
+	}
+	// The block size has to tile a page exactly for the loop below
+	u32 block = dt_cpu_property_u32("riscv,cboz-block-size");
+	if (block < sizeof(u64) || block > BASE_PAGE_SIZE || (block & (block - 1)) != 0) {
+		println("[clear_page_initialize] Unusable cbo.zero block size %d, clearing pages with stores.", block);
+		return;
+	}
+	clear_page_block = block;
+	println("[clear_page_initialize] Clearing pages with cbo.zero, %d byte blocks.", block);
+}
+
+size_t clear_page_block_size(void)
+{
+	return clear_page_block;
+}
+
+void clear_page(void *page)
+{
+	clear_pages(page, 1);
+}
+
+void clear_pages(void *pages, size_t count)
+{
+	ASSERT(ALIGN_DOWN((u64)pages, BASE_PAGE_SIZE) == (u64)pages, "[clear_pages] Unaligned pages %x\n", pages);
+	size_t block = clear_page_block;
+	if (block == 0) {
+		memset(pages, 0, count * BASE_PAGE_SIZE);
+		return;
+	}
+	u8 *end = (u8 *)pages + count * BASE_PAGE_SIZE;
+	for (u8 *p = pages; p < end; p += block) {
+		cbo_zero(p);
+	}
+}
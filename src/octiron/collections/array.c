@@ -0,0 +1,31 @@
+#include <octiron/collections/array.h>
+#include <octiron/kmalloc.h>
+
+#include <kzadhbat/arch/riscv.h>
+#include <kzadhbat/bitmacros.h>
+
+void *array_storage_resize(void *data, size_t used, size_t old_capacity, size_t *capacity)
+{
+	size_t size = kmalloc_size(*capacity);
+	// Storage past KMALLOC_MAX_SIZE is made of pmm frames, grow them in place if the next frames are free
+	if (data != NULL && old_capacity > KMALLOC_MAX_SIZE && size > old_capacity && err_is_ok(pmm_extend(data, size))) {
+		*capacity = size;
+		return data;
+	}
+
+	void *new_data = kmalloc(size);
+	if (new_data == NULL) {
+		return NULL;
+	}
+	if (data != NULL) {
+		memcpy(new_data, data, used);
+		kfree(data);
+	}
+	*capacity = size;
+	return new_data;
+}
+
+void array_storage_free(void *data)
+{
+	kfree(data);
+}
@@ -1,11 +1,15 @@
 #include <octiron/devices/device_tree/device_tree.h>
 #include <octiron/paging.h>
 #include <octiron/collections/array.h>
+#include <octiron/collections/segmented_array.h>
 
 #include <kzadhbat/bitmacros.h>
 #include <kzadhbat/arch/riscv.h>
 #include <kzadhbat/collections/bump_allocator.h>
 
+// Smallest chunk the bumpAllocator allocator of the device tree grows by
+#define DTB_BUMP_CHUNK_SIZE (2 * BASE_PAGE_SIZE)
+
 // Struct forward declarations
 // struct dt;
 // struct dtNode;
@@ -162,19 +166,21 @@ struct dtNode {
 };
 
 DEFINE_ARRAY_STRUCT(dtReservedRegion);
-DEFINE_ARRAY_STRUCT(dtNode);
-DEFINE_ARRAY_STRUCT(dtProperty);
+DEFINE_SEG_ARRAY_STRUCT(dtNode);
+DEFINE_SEG_ARRAY_STRUCT(dtProperty);
 struct dt {
 	/// List of reserved memory regions
 	ARRAY(STRUCT(dtReservedRegion)) reserved_memory;
-	/// List of all device tree nodes. nodes[0] is the root node.
-	ARRAY(STRUCT(dtNode)) nodes;
-	/// List of all device tree properties
-	ARRAY(STRUCT(dtProperty)) properties;
+	/// List of all device tree nodes. nodes[0] is the root node. Nodes link to each other, so they must not move.
+	SEG_ARRAY(STRUCT(dtNode)) nodes;
+	/// List of all device tree properties, linked into lists by their nodes.
+	SEG_ARRAY(STRUCT(dtProperty)) properties;
 	/// bumpAllocator allocator used to allocate strings
 	struct bumpAllocator bump;
 	/// Pointer to the root node of the device tree
 	struct dtNode *root;
+	/// The physical range occupied by the device tree blob
+	struct dtMemoryRange blob;
 	/// Indicates whether the device tree has been initialized
 	bool initialized;
 } state = { 0 };
@@ -206,6 +212,26 @@ enum dtb_StructureToken {
 ///////////////////////////////////////////////////////////////////////////////
 
 
+/// Grows the bumpAllocator allocator of the device tree by at least DTB_BUMP_CHUNK_SIZE.
+errval_t dtb_bump_refill(struct bumpAllocator *bump, size_t min_size, u8 **buf, size_t *len)
+{
+	(void)bump;
+	size_t size = ALIGN_UP(min_size > DTB_BUMP_CHUNK_SIZE ? min_size : DTB_BUMP_CHUNK_SIZE, BASE_PAGE_SIZE);
+	errval_t err = pmm_alloc_flags(size, BASE_PAGE_SIZE, PMM_ALLOC_NO_ZERO, buf);
+	if (err_is_fail(err)) {
+		return err;
+	}
+	*len = size;
+	return ERR_OK;
+}
+
+/// Returns a chunk of the bumpAllocator allocator of the device tree to the pmm.
+void dtb_bump_release(struct bumpAllocator *bump, u8 *buf)
+{
+	(void)bump;
+	pmm_free(buf);
+}
+
 size_t dtb_parse_property(struct dtNode *curr, u8 *structures, u8 *strings, size_t off)
 {
 	u32 prop_len = READ_BIG_ENDIAN_U32(structures + off);
@@ -213,32 +239,32 @@ size_t dtb_parse_property(struct dtNode *curr, u8 *structures, u8 *strings, size
 	u32 name_offset = READ_BIG_ENDIAN_U32(structures + off);
 	off += sizeof(u32);
 
-	const char *prop_name = state.bump.str_copy(&state.bump, &strings[name_offset]);
-	void *prop_value = state.bump.copy(&state.bump, &structures[off], prop_len);
+	const char *prop_name = bump_copy_string(&state.bump, (const char *)&strings[name_offset]);
+	void *prop_value = bump_copy(&state.bump, &structures[off], prop_len);
 	off += ALIGN_UP(prop_len, sizeof(u32));
 
-	ARRAY_PUSH(state.properties, ((struct dtProperty){ .name = prop_name,
-							   .next = curr->properties,
-							   .type = DTB_PROP_RAW,
-							   .data.raw = {
-								   .value = prop_value,
-								   .value_len = prop_len,
-							   } }));
-	struct dtProperty *new = &state.properties.data[ARRAY_SIZE(state.properties) - 1];
+	SEG_ARRAY_PUSH(state.properties, ((struct dtProperty){ .name = prop_name,
+							       .next = curr->properties,
+							       .type = DTB_PROP_RAW,
+							       .data.raw = {
+								       .value = prop_value,
+								       .value_len = prop_len,
+							       } }));
+	struct dtProperty *new = SEG_ARRAY_LAST(state.properties);
 	curr->properties = new;
 	return off;
 }
 
 size_t dtb_parse_node(struct dtNode **curr, u8 *structures, size_t off)
 {
-	const char *name_buf = state.bump.str_copy(&state.bump, (void *)&structures[off]);
+	const char *name_buf = bump_copy_string(&state.bump, (const char *)&structures[off]);
 	ASSERT(name_buf != NULL, "Failed to allocate memory for node name.");
 	size_t name_len = strlen(name_buf) + 1;
 
-	ARRAY_PUSH(state.nodes,
-		   ((struct dtNode){
-			   .name = name_buf, .properties = NULL, .parent = *curr, .children = NULL, .sibling = NULL }));
-	struct dtNode *new = &state.nodes.data[ARRAY_SIZE(state.nodes) - 1];
+	SEG_ARRAY_PUSH(state.nodes,
+		       ((struct dtNode){
+			       .name = name_buf, .properties = NULL, .parent = *curr, .children = NULL, .sibling = NULL }));
+	struct dtNode *new = SEG_ARRAY_LAST(state.nodes);
 	if (*curr == NULL) {
 		*curr = new;
 		return off + ALIGN_UP(name_len, sizeof(u32));
@@ -270,7 +296,7 @@ void dtb_rewrite_property_compatible(struct dtProperty *prop)
 		}
 	}
 
-	prop->data.compat = state.bump.alloc_aligned(&state.bump, sizeof(void *) * (num_strings + 1), sizeof(void *));
+	prop->data.compat = bump_alloc_aligned(&state.bump, sizeof(void *) * (num_strings + 1), sizeof(void *));
 	ASSERT(prop->data.compat != NULL, "Failed to allocate memory for compatible property.");
 	for (size_t i = 0, j = 0; j < value_len; i++) {
 		prop->data.compat[i] = &value[j];
@@ -318,8 +344,8 @@ void dtb_rewrite_property_reg(struct dtProperty *prop, u32 address_cells, u32 si
 	assert(size_cells <= 2);
 
 	// Allocate memory for the reg property
-	void *addresses = state.bump.alloc_aligned(&state.bump, address_size * n_pairs, address_size);
-	void *sizes = state.bump.alloc_aligned(&state.bump, size_size * n_pairs, size_size);
+	void *addresses = bump_alloc_aligned(&state.bump, address_size * n_pairs, address_size);
+	void *sizes = bump_alloc_aligned(&state.bump, size_size * n_pairs, size_size);
 	assert((address_size == 0) ? addresses == NULL : addresses != NULL);
 	assert((size_size == 0) ? sizes == NULL : sizes != NULL);
 
@@ -378,9 +404,9 @@ void dtb_rewrite_property_ranges(struct dtProperty *prop, u32 address_cells, u32
 	size_t n_trips = value_len / (address_size + address_size + size_size);
 
 	// Allocate memory for the buffers
-	void *child_bus_addrs = state.bump.alloc_aligned(&state.bump, address_size * n_trips, address_size);
-	void *parent_bus_addrs = state.bump.alloc_aligned(&state.bump, address_size * n_trips, address_size);
-	void *lengths = state.bump.alloc_aligned(&state.bump, size_size * n_trips, size_size);
+	void *child_bus_addrs = bump_alloc_aligned(&state.bump, address_size * n_trips, address_size);
+	void *parent_bus_addrs = bump_alloc_aligned(&state.bump, address_size * n_trips, address_size);
+	void *lengths = bump_alloc_aligned(&state.bump, size_size * n_trips, size_size);
 
 	for (size_t i = 0, j = 0; i < n_trips; i++) {
 		// Read a child bus address
@@ -707,7 +733,7 @@ void dtb_print_tree(void)
 	println("[dtb_print_tree] Printing the device tree structure:");
 
 	// Recursively print the device tree structure
-	dtb_recursive_print(0, &state.nodes.data[0]);
+	dtb_recursive_print(0, SEG_ARRAY_AT(state.nodes, 0));
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -746,20 +772,18 @@ errval_t dt_initialize(paddr_t dtb_base_addr)
 
 	// Initialize the dt structure
 	state.reserved_memory = ARRAY_INIT(STRUCT(dtReservedRegion));
-	state.nodes = ARRAY_INIT(STRUCT(dtNode));
-	state.properties = ARRAY_INIT(STRUCT(dtProperty));
+	state.nodes = SEG_ARRAY_INIT(STRUCT(dtNode));
+	state.properties = SEG_ARRAY_INIT(STRUCT(dtProperty));
 
-	// Allocate memory for the bumpAllocator allocator, which we will use to allocate strings and other device
-	// tree structures.
-	u8 *allocator_buf = NULL;
-	err = pmm_alloc(2 * BASE_PAGE_SIZE, &allocator_buf);
+	// The bumpAllocator allocator, which we use to allocate strings and other device tree structures, grows
+	// with the size of the blob.
+	err = bump_init(&state.bump, dtb_bump_refill, dtb_bump_release);
 	if (err_is_fail(err))
 		return err;
-	bump_init(&state.bump, allocator_buf, 2 * BASE_PAGE_SIZE);
 
-	// Parse the Memory Reservation Block
+	// Parse the Memory Reservation Block, it is terminated by an entry with both the address and size set to 0
 	u64 *mem_rsvmap = (u64 *)(dtb_base_addr + ENDIANNESS_FLIP_U32(header->off_mem_rsvmap));
-	while (mem_rsvmap[0] != 0 && mem_rsvmap[1] != 0) {
+	for (; mem_rsvmap[0] != 0 || mem_rsvmap[1] != 0; mem_rsvmap += 2) {
 		struct dtReservedRegion rr;
 		rr.address = ENDIANNESS_FLIP_U64(mem_rsvmap[0]);
 		rr.size = ENDIANNESS_FLIP_U64(mem_rsvmap[1]);
@@ -815,10 +839,10 @@ errval_t dt_initialize(paddr_t dtb_base_addr)
 
 dtb_rewrite_pass:
 	// The first allocated node is the root node, so we can set it as the root of the device tree.
-	if (ARRAY_SIZE(state.nodes) == 0) {
+	if (SEG_ARRAY_SIZE(state.nodes) == 0) {
 		return ERR_DTB_NO_NODES;
 	}
-	state.root = &state.nodes.data[0];
+	state.root = SEG_ARRAY_AT(state.nodes, 0);
 
 	// Now that we have parsed the device tree, we can rewrite properties as needed.
 	state.root->address_cells = 2;
@@ -828,7 +852,7 @@ dtb_rewrite_pass:
 		return err_push(err, ERR_DTB_REWRITE_FAILED);
 
 	dtb_print_tree();
-	println("bump free memory: %x bytes", state.bump.size - state.bump.index);
+	println("bump memory: %x bytes in %d chunks", bump_size(&state.bump), state.bump.chunks);
 
 	// Unmap the DTB pages from the kernel's page table.
 	for (paddr_t pa = aligned_base; pa < dtb_base_addr + dtb_size; pa += BASE_PAGE_SIZE) {
@@ -837,7 +861,11 @@ dtb_rewrite_pass:
 			return err_push(RESULT_ERR(res), ERR_DTB_UNMAPPING_FAILED);
 		}
 	}
+	sfence_vma();
 
+	state.blob.base = dtb_base_addr;
+	state.blob.size = dtb_size;
+	state.initialized = true;
 	return ERR_OK;
 }
 
@@ -846,11 +874,227 @@ bool dt_is_initialized(void)
 	return state.initialized;
 }
 
+/// Returns true if the node name matches the path component, the unit address may be left out of the component.
+bool dt_name_matches(const char *name, const char *component, size_t len)
+{
+	if (strncmp(name, component, len) != 0) {
+		return false;
+	}
+	if (name[len] == '\0') {
+		return true;
+	}
+	for (size_t i = 0; i < len; i++) {
+		if (component[i] == '@') {
+			return false;
+		}
+	}
+	return name[len] == '@';
+}
+
 struct dtNode *dt_lookup_node(const char *path)
 {
-	(void) path;
+	if (!state.initialized || path == NULL || path[0] != '/') {
+		return NULL;
+	}
+
 	// Walk through the path, starting from the root node.
-	// struct dtNode *curr = state.root;
-	return NULL; // Placeholder for the actual implementation
+	struct dtNode *curr = state.root;
+	const char *component = path + 1;
+	while (curr != NULL && *component != '\0') {
+		size_t len = 0;
+		while (component[len] != '\0' && component[len] != '/') {
+			len++;
+		}
+		struct dtNode *child = curr->children;
+		while (child != NULL && !dt_name_matches(child->name, component, len)) {
+			child = child->sibling;
+		}
+		curr = child;
+		component += component[len] == '/' ? len + 1 : len;
+	}
+	return curr;
+}
+
+/// Returns the property of the node with the given name, or NULL if the node has no such property.
+struct dtProperty *dt_node_property(struct dtNode *node, const char *name)
+{
+	for (struct dtProperty *prop = node->properties; prop != NULL; prop = prop->next) {
+		if (strcmp(prop->name, name) == 0) {
+			return prop;
+		}
+	}
+	return NULL;
+}
+
+/// Reads the i-th (address, size) pair of a node's reg property.
+struct dtMemoryRange dt_reg_pair(struct dtNode *node, struct dtProperty *reg, size_t i)
+{
+	struct dtMemoryRange range = { 0 };
+	switch (node->address_cells) {
+	case 1:
+		range.base = ((u32 *)reg->data.reg.addresses)[i];
+		break;
+	case 2:
+		range.base = ((u64 *)reg->data.reg.addresses)[i];
+		break;
+	case 3:
+		range.base = (paddr_t)((u128 *)reg->data.reg.addresses)[i];
+		break;
+	default:
+		break;
+	}
+	switch (node->size_cells) {
+	case 1:
+		range.size = ((u32 *)reg->data.reg.sizes)[i];
+		break;
+	case 2:
+		range.size = ((u64 *)reg->data.reg.sizes)[i];
+		break;
+	default:
+		break;
+	}
+	return range;
+}
+
+/// Appends the reg pairs of a node to ranges, counting the pairs that don't fit.
+size_t dt_collect_reg(struct dtNode *node, struct dtMemoryRange *ranges, size_t max, size_t count)
+{
+	struct dtProperty *reg = dt_node_property(node, "reg");
+	if (reg == NULL || reg->type != DTB_PROP_REG) {
+		return count;
+	}
+	for (size_t i = 0; i < reg->data.reg.n_pairs; i++, count++) {
+		if (count < max) {
+			ranges[count] = dt_reg_pair(node, reg, i);
+		}
+	}
+	return count;
+}
+
+size_t dt_memory_ranges(struct dtMemoryRange *ranges, size_t max)
+{
+	if (!state.initialized) {
+		return 0;
+	}
+	size_t count = 0;
+	for (struct dtNode *node = state.root->children; node != NULL; node = node->sibling) {
+		struct dtProperty *type = dt_node_property(node, "device_type");
+		bool IS_MEMORY = type != NULL ? strcmp(type->data.device_type, "memory") == 0 :
+						dt_name_matches(node->name, "memory", 6);
+		if (IS_MEMORY) {
+			count = dt_collect_reg(node, ranges, max, count);
+		}
+	}
+	return count;
+}
+
+size_t dt_reserved_ranges(struct dtMemoryRange *ranges, size_t max)
+{
+	if (!state.initialized) {
+		return 0;
+	}
+	size_t count = 0;
+	for (size_t i = 0; i < ARRAY_SIZE(state.reserved_memory); i++, count++) {
+		if (count < max) {
+			ranges[count].base = state.reserved_memory.data[i].address;
+			ranges[count].size = state.reserved_memory.data[i].size;
+		}
+	}
+	struct dtNode *reserved = dt_lookup_node("/reserved-memory");
+	for (struct dtNode *node = reserved ? reserved->children : NULL; node != NULL; node = node->sibling) {
+		count = dt_collect_reg(node, ranges, max, count);
+	}
+	return count;
+}
+
+struct dtMemoryRange dt_blob_range(void)
+{
+	return state.blob;
+}
+
+/// Returns true if the riscv,isa string isa lists ext. Single letter extensions follow the rv32/rv64 prefix, multi
+/// letter ones come after it as underscore separated components.
+bool dt_isa_string_has(const char *isa, const char *ext)
+{
+	size_t ext_len = strlen(ext);
+	if (strncmp(isa, "rv32", 4) == 0 || strncmp(isa, "rv64", 4) == 0) {
+		isa += 4;
+	}
+	for (const char *c = isa; *c != '\0' && *c != '_'; c++) {
+		if (ext_len == 1 && *c == ext[0]) {
+			return true;
+		}
+	}
+	for (const char *c = isa; *c != '\0'; c++) {
+		if (*c == '_' && strncmp(c + 1, ext, ext_len) == 0 && (c[ext_len + 1] == '_' || c[ext_len + 1] == '\0')) {
+			return true;
+		}
+	}
+	return false;
+}
 
-}
\ No newline at end of file
+/// Returns true if the cpu node lists ext in its riscv,isa-extensions or riscv,isa property.
+bool dt_cpu_node_has_extension(struct dtNode *cpu, const char *ext)
+{
+	// riscv,isa-extensions is a list of NUL separated strings, preferred over the older riscv,isa
+	struct dtProperty *extensions = dt_node_property(cpu, "riscv,isa-extensions");
+	if (extensions != NULL && extensions->type == DTB_PROP_RAW) {
+		const char *value = extensions->data.raw.value;
+		for (u32 i = 0; i < extensions->data.raw.value_len; i += strlen(&value[i]) + 1) {
+			if (strcmp(&value[i], ext) == 0) {
+				return true;
+			}
+		}
+		return false;
+	}
+	struct dtProperty *isa = dt_node_property(cpu, "riscv,isa");
+	if (isa != NULL && isa->type == DTB_PROP_RAW) {
+		return dt_isa_string_has(isa->data.raw.value, ext);
+	}
+	return false;
+}
+
+bool dt_cpu_has_extension(const char *ext)
+{
+	struct dtNode *cpus = dt_lookup_node("/cpus");
+	if (cpus == NULL) {
+		return false;
+	}
+	bool found = false;
+	for (struct dtNode *node = cpus->children; node != NULL; node = node->sibling) {
+		struct dtProperty *type = dt_node_property(node, "device_type");
+		if (type == NULL || strcmp(type->data.device_type, "cpu") != 0) {
+			continue;
+		}
+		// Code runs on every hart, so a single one without the extension rules it out
+		if (!dt_cpu_node_has_extension(node, ext)) {
+			return false;
+		}
+		found = true;
+	}
+	return found;
+}
+
+u32 dt_cpu_property_u32(const char *name)
+{
+	struct dtNode *cpus = dt_lookup_node("/cpus");
+	if (cpus == NULL) {
+		return 0;
+	}
+	u32 value = 0;
+	for (struct dtNode *node = cpus->children; node != NULL; node = node->sibling) {
+		struct dtProperty *type = dt_node_property(node, "device_type");
+		if (type == NULL || strcmp(type->data.device_type, "cpu") != 0) {
+			continue;
+		}
+		struct dtProperty *prop = dt_node_property(node, name);
+		if (prop == NULL || prop->type != DTB_PROP_RAW || prop->data.raw.value_len < sizeof(u32)) {
+			return 0;
+		}
+		u32 hart_value = READ_BIG_ENDIAN_U32(prop->data.raw.value);
+		if (value == 0 || hart_value < value) {
+			value = hart_value;
+		}
+	}
+	return value;
+}
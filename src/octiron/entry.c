@@ -1,7 +1,11 @@
 #include <octiron/uart_ns16550a.h>
 #include <octiron/pmm.h>
+#include <octiron/kmalloc.h>
+#include <octiron/vector.h>
+#include <octiron/clear_page.h>
 #include <octiron/paging.h>
 #include <octiron/devices/device_tree/device_tree.h>
+#include <octiron/bench.h>
 
 #include <kzadhbat/arch/riscv.h>
 #include <kzadhbat/fmtprint.h>
@@ -12,6 +16,19 @@
 __attribute__((aligned(4))) void kmain(void);
 extern void asm_trap_vector(void);
 
+/// The allocation policy of the physical memory manager, selected with -DOCTIRON_PMM_POLICY=<policy> at configure
+/// time.
+#ifndef OCTIRON_PMM_POLICY
+#define OCTIRON_PMM_POLICY PMM_POLICY_BUDDY
+#endif
+
+/// Frames zeroed per iteration of the idle loop, small enough to keep the loop responsive.
+#define PMM_ZERO_POOL_BATCH 4
+
+/// Upper bounds on the memory and reserved ranges taken from the device tree.
+#define KERNEL_MAX_MEMORY_RANGES 8
+#define KERNEL_MAX_RESERVED_RANGES 16
+
 #define EARLY_HEAP_SIZE (128 * BASE_PAGE_SIZE)
 __attribute__((aligned(BASE_PAGE_SIZE))) u8 early_heap[EARLY_HEAP_SIZE] = { 0 };
 
@@ -37,6 +54,124 @@ void kernel_id_map_range(sv39_pageTable *root, paddr_t start, paddr_t end, u64 f
 	}
 }
 
+/// ID maps [start, end) with the largest leaf pages that fit, skipping the pages that are mapped already.
+void kernel_id_map_ram(sv39_pageTable *root, paddr_t start, paddr_t end, u64 flags)
+{
+	paddr_t pa = ALIGN_DOWN(start, BASE_PAGE_SIZE);
+	end = ALIGN_UP(end, BASE_PAGE_SIZE);
+	print("[kernel_id_map_ram] Mapping RAM: %x to %x with flags: %x\n", pa, end, flags);
+
+	size_t leaves[] = { 0, 0, 0 };
+	while (pa < end) {
+		// Try the largest page first, falling back to smaller ones when part of it is mapped already
+		for (int type = sv39_GigaPage; type >= sv39_Page; type--) {
+			u64 size = sv39_pageSizes[type];
+			if (ALIGN_DOWN(pa, size) != pa || pa + size > end) {
+				continue;
+			}
+			errval_t err = sv39_map(root, pa, pa, flags, type);
+			if (err_is_ok(err)) {
+				leaves[type]++;
+				pa += size;
+				break;
+			}
+			if (err_top(err) != ERR_PAGING_MAPPING_EXISTS) {
+				PANIC_LOOP("[kernel_id_map_ram] Failed to map address %x: %s\n", pa, err_str(err));
+			}
+			if (type == sv39_Page) {
+				pa += size;
+			}
+		}
+	}
+	print("[kernel_id_map_ram] Mapped %d giga, %d mega and %d small pages.\n", leaves[sv39_GigaPage],
+	      leaves[sv39_MegaPage], leaves[sv39_Page]);
+}
+
+/// Adds [start, end) to the pmm, leaving out the parts covered by any of the reserved ranges.
+void kernel_add_ram(paddr_t start, paddr_t end, struct dtMemoryRange *reserved, size_t count)
+{
+	for (size_t i = 0; i < count && start < end; i++) {
+		paddr_t reserved_start = reserved[i].base;
+		paddr_t reserved_end = reserved[i].base + reserved[i].size;
+		if (reserved_end <= start || reserved_start >= end) {
+			continue;
+		}
+		// Add the part below the reservation and carry on with the part above it
+		if (reserved_start > start) {
+			kernel_add_ram(start, reserved_start, reserved + i + 1, count - i - 1);
+		}
+		start = reserved_end;
+	}
+	if (start >= end) {
+		return;
+	}
+	errval_t err = pmm_add_region((void *)start, end - start);
+	if (err_is_fail(err) && err_top(err) != ERR_PMM_ADD_REGION_TOO_SMALL) {
+		print("[kernel_add_ram] Failed to add %x to %x to the pmm: %s\n", start, end, err_str(err));
+	}
+}
+
+/// Hands all of the RAM described by the device tree to the pmm.
+///
+/// The memory is carved up before it is added rather than removed afterwards, as the buddy and bitmap backends write
+/// their metadata into a region as soon as it is added.
+void kernel_discover_ram(sv39_pageTable *root)
+{
+	struct dtMemoryRange memory[KERNEL_MAX_MEMORY_RANGES];
+	size_t memory_count = dt_memory_ranges(memory, KERNEL_MAX_MEMORY_RANGES);
+	if (memory_count > KERNEL_MAX_MEMORY_RANGES) {
+		print("[kernel_discover_ram] Ignoring %d memory ranges.\n", memory_count - KERNEL_MAX_MEMORY_RANGES);
+		memory_count = KERNEL_MAX_MEMORY_RANGES;
+	}
+
+	// The kernel image (which holds the early heap) and the device tree blob come first
+	struct dtMemoryRange reserved[KERNEL_MAX_RESERVED_RANGES + 2];
+	reserved[0].base = TEXT_START;
+	reserved[0].size = STACK_END - TEXT_START;
+	reserved[1] = dt_blob_range();
+	size_t reserved_count = dt_reserved_ranges(reserved + 2, KERNEL_MAX_RESERVED_RANGES);
+	if (reserved_count > KERNEL_MAX_RESERVED_RANGES) {
+		PANIC_LOOP("[kernel_discover_ram] Too many reserved ranges: %d\n", reserved_count);
+	}
+	reserved_count += 2;
+
+	// The backends keep their metadata inside of the regions, so they have to be mapped before they are added
+	for (size_t i = 0; i < memory_count; i++) {
+		kernel_id_map_ram(root, memory[i].base, memory[i].base + memory[i].size,
+				  SV39_FLAGS_READ | SV39_FLAGS_WRITE);
+	}
+	sfence_vma();
+
+	// Adding the regions is dominated by the initialization of their frame descriptors
+	u64 start = cpu_time();
+	for (size_t i = 0; i < memory_count; i++) {
+		kernel_add_ram(memory[i].base, memory[i].base + memory[i].size, reserved, reserved_count);
+	}
+	u64 ticks = cpu_time() - start;
+	print("[kernel_discover_ram] pmm manages %x bytes of RAM.\n", pmm_total_mem());
+	print("[kernel_discover_ram] Added in %d ticks, %d byte frame descriptors take %x bytes.\n", ticks,
+	      sizeof(struct pmmFrame), pmm_frame_db_mem());
+}
+
+/// Sets bits in menvcfg, returning false if the hart has no such register. menvcfg came with privileged spec 1.12,
+/// older harts raise an illegal instruction exception on the access, which mtvec points past while it runs.
+bool kernel_try_set_menvcfg(u64 bits)
+{
+	u64 set;
+	asm volatile("la t0, 1f\n"
+		     "csrrw t0, mtvec, t0\n"
+		     "li %0, 0\n"
+		     "csrs menvcfg, %1\n"
+		     "li %0, 1\n"
+		     // mtvec needs a 4 byte aligned base
+		     ".balign 4\n"
+		     "1: csrw mtvec, t0\n"
+		     : "=&r"(set)
+		     : "r"(bits)
+		     : "t0", "memory");
+	return set;
+}
+
 void kinit(void)
 {
 	errval_t err;
@@ -84,7 +219,7 @@ void kinit(void)
 	print("[kinit] Device Tree Blob Start: %x\n", dtb_base_addr);
 
 	// Initialize the physical memory manager
-	err = pmm_initialize();
+	err = pmm_initialize(OCTIRON_PMM_POLICY);
 	if (err_is_fail(err)) {
 		PANIC_LOOP("[kinit] Failed to initialize pmm: %s\n", err_str(err));
 	}
@@ -94,6 +229,10 @@ void kinit(void)
 		PANIC_LOOP("[kinit] Failed to add initial pmm region: %s\n", err_str(err));
 	}
 	print("[kinit] pmm initialized with the early heap memory (%x bytes).\n", pmm_total_mem());
+	err = kmalloc_initialize();
+	if (err_is_fail(err)) {
+		PANIC_LOOP("[kinit] Failed to initialize kmalloc: %s\n", err_str(err));
+	}
 
 	// Initialize kernel paging
 	sv39_pageTable *root = sv39_kernel_page_table();
@@ -147,6 +286,12 @@ void kinit(void)
 	csrw_mideleg((1 << 1) | (1 << 5) | (1 << 9));
 	// Set the sie register to match the value of mideleg
 	csrw_sie((1 << 1) | (1 << 5) | (1 << 9));
+	// Let the supervisor mode read the cycle, time and instret counters
+	csrw_mcounteren((1 << 0) | (1 << 1) | (1 << 2));
+	// Let the supervisor mode zero cache blocks, clear_page_initialize decides whether it does
+	if (!kernel_try_set_menvcfg(MENVCFG_CBZE)) {
+		print("[kinit] The harts predate menvcfg, cbo.zero stays off.\n");
+	}
 	// Set the stvec register to point to the kerne's trap handler
 	csrw_stvec((u64) asm_trap_vector);
 	// Set the satp value to the root of the kernel page table with the SV39 mode enabled
@@ -176,9 +321,30 @@ __attribute__((aligned(4))) void kmain(void)
 		PANIC_LOOP("[kmain] Failed to parse DTB: %s\n", err_str(err));
 	}
 
+	// The device tree also tells us whether the harts have a vector unit
+	err = vector_initialize();
+	if (err_is_fail(err)) {
+		PANIC_LOOP("[kmain] Failed to initialize the vector unit: %s\n", err_str(err));
+	}
+	// and whether pages can be zeroed a cache block at a time
+	clear_page_initialize();
+
+	// Now that the device tree told us where the RAM is, the pmm can grow beyond the early heap
+	kernel_discover_ram(sv39_kernel_page_table());
+
+	pmm_print_stats();
+	kmalloc_print_stats();
+
+#ifdef ENABLE_BENCHMARKS
+	bench_run_all();
+#endif
+
 	// Main loop of the kernel
 	print("[kmain] Kernel loop reached.\n");
 	while (1) {
 		// Here you would typically handle interrupts, system calls, etc.
+
+		// Spend idle time zeroing frames ahead of the allocations that need them
+		pmm_zero_pool_refill(PMM_ZERO_POOL_BATCH);
 	}
 }
@@ -0,0 +1,136 @@
+#include <octiron/kmalloc.h>
+#include <octiron/pmm.h>
+
+#include <kzadhbat/arch/riscv.h>
+#include <kzadhbat/bitmacros.h>
+#include <kzadhbat/collections/slab_cache.h>
+#include <kzadhbat/fmtprint.h>
+
+/// Size classes, spaced at most 50% apart. The largest ones are the largest block sizes fitting 5, 4, 3 and 2 blocks
+/// into a slab region, so they waste no more than their neighbours.
+static const size_t kmalloc_class_sizes[KMALLOC_CLASS_COUNT] = {
+	16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1008, 1344, KMALLOC_MAX_SIZE,
+};
+SASSERT(KMALLOC_MAX_SIZE * 2 + sizeof(struct slabRegion) <= SLAB_REGION_ALIGN,
+	"Two of the largest kmalloc blocks must fit into a slab region");
+
+struct slabCache kmalloc_classes[KMALLOC_CLASS_COUNT];
+struct magazine kmalloc_magazines[KMALLOC_CLASS_COUNT][SLAB_CACHE_MAGAZINE_COUNT];
+static const char *kmalloc_class_names[KMALLOC_CLASS_COUNT] = {
+	"kmalloc-16",  "kmalloc-32",  "kmalloc-48",  "kmalloc-64",   "kmalloc-96",   "kmalloc-128",  "kmalloc-192",
+	"kmalloc-256", "kmalloc-384", "kmalloc-512", "kmalloc-768", "kmalloc-1008", "kmalloc-1344", "kmalloc-2016",
+};
+
+/// Grows a size class by a frame of the pmm.
+errval_t kmalloc_refill(struct slabAllocator *slabs)
+{
+	u8 *frame = NULL;
+	errval_t err = pmm_alloc_flags(BASE_PAGE_SIZE, BASE_PAGE_SIZE, PMM_ALLOC_NO_ZERO, &frame);
+	if (err_is_fail(err)) {
+		return err;
+	}
+	pmm_frame_set_type(frame, PMM_FRAME_SLAB, 0);
+	return slab_grow(slabs, frame, BASE_PAGE_SIZE);
+}
+
+/// Hands an empty slab region of a size class back to the pmm.
+errval_t kmalloc_release(struct slabAllocator *slabs, void *buf)
+{
+	(void)slabs;
+	return pmm_free(buf);
+}
+
+errval_t kmalloc_initialize(void)
+{
+	errval_t err = err_new();
+	for (size_t i = 0; i < KMALLOC_CLASS_COUNT; i++) {
+		struct slabCache *cache = &kmalloc_classes[i];
+		if (err_is_fail((err = slab_cache_init(cache, kmalloc_class_names[i], kmalloc_class_sizes[i], NULL, NULL,
+						       kmalloc_magazines[i], SLAB_CACHE_MAGAZINE_COUNT)))) {
+			return err_push(err, ERR_KMALLOC_INIT);
+		}
+		// Refill only once the class runs dry, kmalloc_refill takes its frame from the pmm, not the class
+		if (err_is_fail((err = slab_set_refill(slab_cache_slabs(cache), kmalloc_refill, 0)))) {
+			return err_push(err, ERR_KMALLOC_INIT);
+		}
+		if (err_is_fail((err = slab_set_release(slab_cache_slabs(cache), kmalloc_release)))) {
+			return err_push(err, ERR_KMALLOC_INIT);
+		}
+	}
+	return ERR_OK;
+}
+
+/// Returns the index of the smallest size class holding size bytes.
+size_t kmalloc_class_of(size_t size)
+{
+	size_t i = 0;
+	while (kmalloc_class_sizes[i] < size) {
+		i++;
+	}
+	return i;
+}
+
+void *kmalloc(size_t size)
+{
+	if (size > KMALLOC_MAX_SIZE) {
+		u8 *frames = NULL;
+		errval_t err = pmm_alloc_flags(ALIGN_UP(size, BASE_PAGE_SIZE), BASE_PAGE_SIZE, PMM_ALLOC_NO_ZERO, &frames);
+		return err_is_ok(err) ? frames : NULL;
+	}
+	struct slabCache *cache = &kmalloc_classes[kmalloc_class_of(size)];
+	void *block = slab_cache_alloc(cache);
+	if (block == NULL) {
+		// Under memory pressure the other classes' empty regions may make the difference
+		kmalloc_reclaim();
+		block = slab_cache_alloc(cache);
+	}
+	return block;
+}
+
+size_t kmalloc_size(size_t size)
+{
+	if (size > KMALLOC_MAX_SIZE) {
+		return ALIGN_UP(size, BASE_PAGE_SIZE);
+	}
+	return kmalloc_class_sizes[kmalloc_class_of(size)];
+}
+
+errval_t kfree(void *ptr)
+{
+	if (ptr == NULL) {
+		return ERR_OK;
+	}
+	// Slab blocks never start a frame, the region header does
+	if (ALIGN_DOWN((uintptr_t)ptr, BASE_PAGE_SIZE) == (uintptr_t)ptr) {
+		return pmm_free(ptr);
+	}
+
+	// The region header names the slabAllocator, which is embedded in the size class
+	struct slabRegion *region = (struct slabRegion *)ALIGN_DOWN((uintptr_t)ptr, SLAB_REGION_ALIGN);
+	struct slabAllocator *slabs = region->slabs;
+	for (size_t i = 0; i < KMALLOC_CLASS_COUNT; i++) {
+		if (slab_cache_slabs(&kmalloc_classes[i]) == slabs) {
+			return slab_cache_free(&kmalloc_classes[i], ptr);
+		}
+	}
+	return ERR_KMALLOC_INVALID_FREE;
+}
+
+void kmalloc_reclaim(void)
+{
+	for (size_t i = 0; i < KMALLOC_CLASS_COUNT; i++) {
+		slab_cache_reclaim(&kmalloc_classes[i]);
+	}
+}
+
+void kmalloc_print_stats(void)
+{
+	println("[kmalloc] size class occupancy:");
+	for (size_t i = 0; i < KMALLOC_CLASS_COUNT; i++) {
+		struct slabCache *cache = &kmalloc_classes[i];
+		if (cache->slabs.total == 0) {
+			continue;
+		}
+		slab_cache_print_stats(cache);
+	}
+}
@@ -77,24 +77,39 @@ errval_t sv39_map_small_page(sv39_tableEntry *root, vaddr_t va, paddr_t pa, u64
 	sv39_tableEntry *l2 = root;
 	sv39_tableEntry *l1 = NULL;
 	sv39_tableEntry l2_entry = l2[vpn[2]];
+	size_t missing = 0;
 	if (!SV39_PTE_VALID(l2_entry)) {
-		u8 *page = NULL;
-		err = pmm_alloc(sizeof(sv39_pageTable), (u8 **)&page);
-		if (err_is_fail(err)) {
-			return err_push(err, ERR_PAGING_SETUP_TABLE);
+		missing = 2;
+	} else if (SV39_PTE_LEAF(l2_entry)) {
+		// The page is already covered by a giga page
+		return err_push(err, ERR_PAGING_MAPPING_EXISTS);
+	} else {
+		l1 = (sv39_tableEntry *)SV39_PTE_PPN_TO_PADDR(l2_entry);
+		sv39_tableEntry l1_entry = l1[vpn[1]];
+		if (SV39_PTE_VALID(l1_entry) && SV39_PTE_LEAF(l1_entry)) {
+			// The page is already covered by a mega page
+			return err_push(err, ERR_PAGING_MAPPING_EXISTS);
 		}
-		l2[vpn[2]] = ((sv39_tableEntry)page >> 2) | SV39_FLAGS_VALID;
+		missing = SV39_PTE_VALID(l1_entry) ? 0 : 1;
 	}
-	l1 = (sv39_tableEntry *)SV39_PTE_PPN_TO_PADDR(l2[vpn[2]]);
 
-	sv39_tableEntry l1_entry = l1[vpn[1]];
-	if (!SV39_PTE_VALID(l1_entry)) {
-		u8 *page = NULL;
-		err = pmm_alloc(sizeof(sv39_pageTable), (u8 **)&page);
+	// Allocate all of the missing intermediate tables at once
+	u8 *tables[2] = { NULL, NULL };
+	if (missing > 0) {
+		err = pmm_alloc_batch(missing, tables);
 		if (err_is_fail(err)) {
 			return err_push(err, ERR_PAGING_SETUP_TABLE);
 		}
-		l1[vpn[1]] = ((sv39_tableEntry)page >> 2) | SV39_FLAGS_VALID;
+		for (size_t i = 0; i < missing; i++) {
+			pmm_frame_set_type(tables[i], PMM_FRAME_PAGE_TABLE, 0);
+		}
+	}
+	if (missing == 2) {
+		l2[vpn[2]] = ((sv39_tableEntry)tables[1] >> 2) | SV39_FLAGS_VALID;
+		l1 = (sv39_tableEntry *)tables[1];
+	}
+	if (missing > 0) {
+		l1[vpn[1]] = ((sv39_tableEntry)tables[0] >> 2) | SV39_FLAGS_VALID;
 	}
 	sv39_tableEntry *l0 = (sv39_tableEntry *)((l1[vpn[1]] >> 10) << 12);
 
@@ -107,20 +122,55 @@ errval_t sv39_map_small_page(sv39_tableEntry *root, vaddr_t va, paddr_t pa, u64
 
 errval_t sv39_map_mega_page(sv39_tableEntry *root, vaddr_t va, paddr_t pa, u64 flags)
 {
-	(void)root;
-	(void)va;
-	(void)pa;
-	(void)flags;
-	return ERR_NOT_IMPLEMENTED;
+	errval_t err = err_new();
+	if (!IS_ALIGNED(va, sv39_pageSizes[sv39_MegaPage]) || !IS_ALIGNED(pa, sv39_pageSizes[sv39_MegaPage])) {
+		return ERR_PAGING_UNALIGNED_ADDRESS;
+	}
+
+	vaddr_t vpn[] = {
+		(va >> 12) & 0x1FF, // Level 0 index
+		(va >> 21) & 0x1FF, // Level 1 index
+		(va >> 30) & 0x1FF // Level 2 index
+	};
+
+	sv39_tableEntry *l2 = root;
+	sv39_tableEntry l2_entry = l2[vpn[2]];
+	if (!SV39_PTE_VALID(l2_entry)) {
+		u8 *page = NULL;
+		err = pmm_alloc(sizeof(sv39_pageTable), (u8 **)&page);
+		if (err_is_fail(err)) {
+			return err_push(err, ERR_PAGING_SETUP_TABLE);
+		}
+		pmm_frame_set_type(page, PMM_FRAME_PAGE_TABLE, 0);
+		l2[vpn[2]] = ((sv39_tableEntry)page >> 2) | SV39_FLAGS_VALID;
+	} else if (SV39_PTE_LEAF(l2_entry)) {
+		// The page is already covered by a giga page
+		return err_push(err, ERR_PAGING_MAPPING_EXISTS);
+	}
+	sv39_tableEntry *l1 = (sv39_tableEntry *)SV39_PTE_PPN_TO_PADDR(l2[vpn[2]]);
+
+	// A valid entry is either a mega page or a table holding smaller pages
+	if (SV39_PTE_VALID(l1[vpn[1]])) {
+		return err_push(err, ERR_PAGING_MAPPING_EXISTS);
+	}
+	l1[vpn[1]] = ((pa >> 12) << 10) | flags | SV39_FLAGS_VALID;
+	return ERR_OK;
 }
 
 errval_t sv39_map_giga_page(sv39_tableEntry *root, vaddr_t va, paddr_t pa, u64 flags)
 {
-	(void)root;
-	(void)va;
-	(void)pa;
-	(void)flags;
-	return ERR_NOT_IMPLEMENTED;
+	errval_t err = err_new();
+	if (!IS_ALIGNED(va, sv39_pageSizes[sv39_GigaPage]) || !IS_ALIGNED(pa, sv39_pageSizes[sv39_GigaPage])) {
+		return ERR_PAGING_UNALIGNED_ADDRESS;
+	}
+
+	// A valid entry is either a giga page or a table holding smaller pages
+	vaddr_t vpn2 = (va >> 30) & 0x1FF;
+	if (SV39_PTE_VALID(root[vpn2])) {
+		return err_push(err, ERR_PAGING_MAPPING_EXISTS);
+	}
+	root[vpn2] = ((pa >> 12) << 10) | flags | SV39_FLAGS_VALID;
+	return ERR_OK;
 }
 
 RESULT(paddr_t) sv39_unmap(sv39_pageTable *root, vaddr_t va)
@@ -180,7 +230,7 @@ OPT(paddr_t) sv39_virt_to_phys(sv39_pageTable *root, vaddr_t va)
 		(va >> 21) & 0x1FF,
 		(va >> 30) & 0x1FF,
 	};
-	paddr_t page_offset = va & (sv39_pageSizes[sv39_Page]);
+	paddr_t page_offset = va & (sv39_pageSizes[sv39_Page] - 1);
 
 	sv39_tableEntry *table = (sv39_tableEntry *) root;
 	for (int level = 2; level >= 0; level--) {
@@ -195,10 +245,12 @@ OPT(paddr_t) sv39_virt_to_phys(sv39_pageTable *root, vaddr_t va)
 			paddr_t pa;
 			switch (level) {
 			case 2:
-				pa = (ppn << 30) | (vpn[1] << 21) | (vpn[0] << 12);
+				// The ppn of a giga page has its low 18 bits cleared
+				pa = (ppn << 12) | (vpn[1] << 21) | (vpn[0] << 12);
 				break;
 			case 1:
-				pa = (ppn << 21) | (vpn[0] << 12);
+				// The ppn of a mega page has its low 9 bits cleared
+				pa = (ppn << 12) | (vpn[0] << 12);
 				break;
 			default:
 				pa = ppn << 12;
@@ -1,4 +1,6 @@
 #include <octiron/pmm.h>
+#include <octiron/pmm_internal.h>
+#include <octiron/clear_page.h>
 
 #include <kzadhbat/assert.h>
 #include <kzadhbat/types/error.h>
@@ -7,52 +9,19 @@
 #include <kzadhbat/fmtprint.h>
 #include <kzadhbat/libc/string.h>
 
-#define PMM_REGION_COUNT 16
-
-struct pmmRegion {
-	// /// @brief The next region in the list.
-	// struct pmmRegion *next;
-	/// @brief  The base address of the region.
-	paddr_t base;
-	/// @brief  Length of the region in bytes.
-	size_t size;
-	/// @brief  Count of total bytes free in this region.
-	size_t free;
-	/// @brief  Free list of blocks in this region.
-	struct pmmBlock *free_blocks;
-};
-
-struct pmm {
-	/// @brief  List of contiguous regions from which memory can be allocated.
-	struct pmmRegion regions[PMM_REGION_COUNT];
-	/// @brief  Number of regions in the list.
-	size_t region_count;
-	/// @brief  Slab allocator for mmBlock structures.
-	struct slabAllocator block_allocator;
-	/// @brief  Total amount of memory managed by the allocator.
-	size_t total;
-	/// @brief  Total amount of free memory managed by the allocator.
-	size_t free;
-	/// @brief  The policy used for allocation.
-	enum pmmPolicy policy;
-	/// @brief  Check whether the pmm is initialized.
-	bool initialized;
-} pmm;
-
-struct pmmBlock {
-	/// @brief  Base address of the block.
-	paddr_t base;
-	/// @brief  Size of the block in bytes.
-	size_t size;
-	/// @brief  Pointer to the next free block in the region.
-	struct pmmBlock *next;
-};
-SASSERT(sizeof(struct pmmBlock) == 24, "pmmBlock must be 24 bytes wide");
-
-#define INITIAL_PMM_SLAB_SZ SLAB_REGION_SIZE(64, sizeof(struct pmmBlock))
-u8 pmm_initial_region_slab[INITIAL_PMM_SLAB_SZ];
-
-errval_t pmm_initialize(void)
+struct pmm pmm;
+struct magazine pmm_page_magazines[PMM_PAGE_MAGAZINE_COUNT];
+
+// Forward declarations
+errval_t pmm_block_refill(struct slabAllocator *slabs);
+errval_t pmm_block_release(struct slabAllocator *slabs, void *buf);
+size_t pmm_page_fill(void *ctx, void **pages, size_t count);
+void pmm_page_drain(void *ctx, void **pages, size_t count);
+
+#define INITIAL_PMM_SLAB_SZ SLAB_REGION_ALIGN
+__attribute__((aligned(SLAB_REGION_ALIGN))) u8 pmm_initial_region_slab[INITIAL_PMM_SLAB_SZ];
+
+errval_t pmm_initialize(enum pmmPolicy policy)
 {
 	errval_t err = err_new();
 	// Initialize the slab allocator for the regions
@@ -63,16 +32,365 @@ errval_t pmm_initialize(void)
 	if (err_is_fail((err = slab_grow(&pmm.block_allocator, pmm_initial_region_slab, INITIAL_PMM_SLAB_SZ)))) {
 		return err_push(err, ERR_PMM_INIT);
 	}
+	// From then on it grows itself with frames carved from the pmm
+	if (err_is_fail((err = slab_set_refill(&pmm.block_allocator, pmm_block_refill, PMM_BLOCK_WATERMARK)))) {
+		return err_push(err, ERR_PMM_INIT);
+	}
+	if (err_is_fail((err = slab_set_release(&pmm.block_allocator, pmm_block_release)))) {
+		return err_push(err, ERR_PMM_INIT);
+	}
+	// Set up the per-hart page caches
+	if (err_is_fail((err = magazine_init(&pmm.page_cache, "pmm pages", pmm_page_magazines, PMM_PAGE_MAGAZINE_COUNT,
+					     pmm_page_fill, pmm_page_drain, NULL)))) {
+		return err_push(err, ERR_PMM_INIT);
+	}
 	// Initialize the pmm structure
+	spinlock_init(&pmm.lock);
+	spinlock_init(&pmm.zero_pool.lock);
+	pmm.zero_pool.frames = NULL;
+	memset(&pmm.zero_pool.stats, 0, sizeof(pmm.zero_pool.stats));
 	pmm.region_count = 0;
 	pmm.total = 0;
 	pmm.free = 0;
-	pmm.policy = PMM_POLICY_FIRST_FIT;
+	pmm.huge_free = 0;
+	pmm.frame_db = 0;
+	pmm.policy = policy;
+	pmm.initialized = true;
 	return ERR_OK;
 }
 
-errval_t pmm_add_region(void *base, size_t size)
+struct pmmRegion *pmm_find_region(paddr_t addr)
+{
+	for (size_t i = 0; i < pmm.region_count; i++) {
+		struct pmmRegion *region = &pmm.regions[i];
+		if (addr >= region->base && addr < region->base + region->size) {
+			return region;
+		}
+	}
+	return NULL;
+}
+
+/// Permanently removes [base, base + size) from the free memory of the region's backend.
+errval_t pmm_backend_reserve(struct pmmRegion *region, paddr_t base, size_t size)
+{
+	switch (pmm.policy) {
+	case PMM_POLICY_FIRST_FIT:
+	case PMM_POLICY_BEST_FIT:
+	case PMM_POLICY_WORST_FIT:
+		return pmm_extent_reserve(region, base, size);
+	case PMM_POLICY_BUDDY:
+		return pmm_buddy_reserve(region, base, size);
+	case PMM_POLICY_BITMAP:
+		return pmm_bitmap_reserve(region, base, size);
+	}
+	return ERR_OK;
+}
+
+/// Returns a range removed with pmm_backend_reserve to the region's backend.
+errval_t pmm_backend_release(struct pmmRegion *region, paddr_t base, size_t size)
+{
+	switch (pmm.policy) {
+	case PMM_POLICY_FIRST_FIT:
+	case PMM_POLICY_BEST_FIT:
+	case PMM_POLICY_WORST_FIT:
+		return pmm_extent_release(region, base, size);
+	case PMM_POLICY_BUDDY:
+		return pmm_buddy_release(region, base, size);
+	case PMM_POLICY_BITMAP:
+		return pmm_bitmap_release(region, base, size);
+	}
+	return ERR_OK;
+}
+
+#define HUGE_TEST(map, i) (((map)[(i) / 64] & ((u64)1 << ((i) % 64))) != 0)
+#define HUGE_SET(map, i) ((map)[(i) / 64] |= ((u64)1 << ((i) % 64)))
+#define HUGE_CLEAR(map, i) ((map)[(i) / 64] &= ~((u64)1 << ((i) % 64)))
+#define HUGE_SLOT_ADDR(huge, i) ((huge)->base + (i) * PMM_HUGE_SLOT_SIZE)
+
+/// Holds every 2 MiB slot of a freshly added region back from its backend. The caller must hold pmm.lock.
+void pmm_huge_region_init(struct pmmRegion *region)
+{
+	struct pmmHuge *huge = &region->huge;
+	memset(huge, 0, sizeof(*huge));
+	huge->base = ALIGN_UP(region->base + region->metadata, PMM_HUGE_SLOT_SIZE);
+	paddr_t end = ALIGN_DOWN(region->base + region->size, PMM_HUGE_SLOT_SIZE);
+	if (end <= huge->base) {
+		return;
+	}
+	huge->slot_count = (end - huge->base) / PMM_HUGE_SLOT_SIZE;
+	if (huge->slot_count > PMM_HUGE_SLOTS) {
+		huge->slot_count = PMM_HUGE_SLOTS;
+	}
+	for (size_t i = 0; i < huge->slot_count; i++) {
+		if (err_is_ok(pmm_backend_reserve(region, HUGE_SLOT_ADDR(huge, i), PMM_HUGE_SLOT_SIZE))) {
+			HUGE_SET(huge->intact, i);
+			pmm.free -= PMM_HUGE_SLOT_SIZE;
+			pmm.huge_free += PMM_HUGE_SLOT_SIZE;
+		} else {
+			HUGE_SET(huge->pinned, i);
+		}
+	}
+}
+
+/// Returns the number of intact slots in the 1 GiB group at group, clipped to the slots of the region as
+/// [*first, *last).
+size_t pmm_huge_group(struct pmmHuge *huge, paddr_t group, size_t *first, size_t *last)
 {
+	paddr_t end = HUGE_SLOT_ADDR(huge, huge->slot_count);
+	*first = group > huge->base ? (group - huge->base) / PMM_HUGE_SLOT_SIZE : 0;
+	*last = group + PMM_HUGE_GIGA_SIZE < end ? (group + PMM_HUGE_GIGA_SIZE - huge->base) / PMM_HUGE_SLOT_SIZE
+						 : huge->slot_count;
+	size_t intact = 0;
+	for (size_t i = *first; i < *last; i++) {
+		intact += HUGE_TEST(huge->intact, i);
+	}
+	return intact;
+}
+
+/// Finds an intact slot, the lowest one or the highest one. Slots of groups that could still back a giga frame are
+/// only taken once no other slot is left.
+bool pmm_huge_find(bool highest, struct pmmRegion **found, size_t *slot)
+{
+	if (pmm.huge_free == 0) {
+		return false;
+	}
+	for (int pass = 0; pass < 2; pass++) {
+		for (size_t r = 0; r < pmm.region_count; r++) {
+			struct pmmRegion *region = &pmm.regions[highest ? pmm.region_count - 1 - r : r];
+			struct pmmHuge *huge = &region->huge;
+			if (huge->slot_count == 0) {
+				continue;
+			}
+			paddr_t low = ALIGN_DOWN(huge->base, PMM_HUGE_GIGA_SIZE);
+			paddr_t high = ALIGN_DOWN(HUGE_SLOT_ADDR(huge, huge->slot_count) - 1, PMM_HUGE_GIGA_SIZE);
+			size_t groups = (high - low) / PMM_HUGE_GIGA_SIZE + 1;
+			for (size_t g = 0; g < groups; g++) {
+				paddr_t group = highest ? high - g * PMM_HUGE_GIGA_SIZE : low + g * PMM_HUGE_GIGA_SIZE;
+				size_t first = 0;
+				size_t last = 0;
+				size_t intact = pmm_huge_group(huge, group, &first, &last);
+				bool WHOLE_GROUP = intact == PMM_HUGE_GIGA_SLOTS;
+				if (intact == 0 || (WHOLE_GROUP && pass == 0)) {
+					continue;
+				}
+				for (size_t i = 0; i < last - first; i++) {
+					size_t candidate = highest ? last - 1 - i : first + i;
+					if (HUGE_TEST(huge->intact, candidate)) {
+						*found = region;
+						*slot = candidate;
+						return true;
+					}
+				}
+			}
+		}
+	}
+	return false;
+}
+
+/// Hands the lowest intact slot to its backend, once the backends are out of memory. Returns false if no slot is
+/// left. The caller must hold pmm.lock.
+bool pmm_huge_break(void)
+{
+	struct pmmRegion *region = NULL;
+	size_t slot = 0;
+	if (!pmm_huge_find(false, &region, &slot)) {
+		return false;
+	}
+	struct pmmHuge *huge = &region->huge;
+	HUGE_CLEAR(huge->intact, slot);
+	pmm.huge_free -= PMM_HUGE_SLOT_SIZE;
+	errval_t err = pmm_backend_release(region, HUGE_SLOT_ADDR(huge, slot), PMM_HUGE_SLOT_SIZE);
+	ASSERT(err_is_ok(err), "[pmm_huge_break] Failed to release slot %x: %s\n", HUGE_SLOT_ADDR(huge, slot),
+	       err_str(err));
+	pmm.free += PMM_HUGE_SLOT_SIZE;
+	return true;
+}
+
+/// Takes a broken slot none of whose frames are in use back from its backend. The reserve may refill the block slab
+/// out of this very slot, it is then simply left broken until it drains again. The caller must hold pmm.lock.
+void pmm_huge_reform(struct pmmRegion *region, size_t slot)
+{
+	struct pmmHuge *huge = &region->huge;
+	if (err_is_ok(pmm_backend_reserve(region, HUGE_SLOT_ADDR(huge, slot), PMM_HUGE_SLOT_SIZE))) {
+		HUGE_SET(huge->intact, slot);
+		pmm.free -= PMM_HUGE_SLOT_SIZE;
+		pmm.huge_free += PMM_HUGE_SLOT_SIZE;
+	}
+}
+
+/// Reforms every broken slot that none of the backends' allocations reach into, like the ones pmm_huge_break gave up
+/// for a request that failed anyway. The caller must hold pmm.lock.
+void pmm_huge_mend(void)
+{
+	for (size_t r = 0; r < pmm.region_count; r++) {
+		struct pmmRegion *region = &pmm.regions[r];
+		struct pmmHuge *huge = &region->huge;
+		for (size_t i = 0; i < huge->slot_count; i++) {
+			if (huge->used[i] == 0 && !HUGE_TEST(huge->intact, i) && !HUGE_TEST(huge->allocated, i) &&
+			    !HUGE_TEST(huge->pinned, i)) {
+				pmm_huge_reform(region, i);
+			}
+		}
+	}
+}
+
+/// Counts the frames a backend hands out of (or gets back into) broken slots, and takes a broken slot back from the
+/// backend once all of its frames are free again. The caller must hold pmm.lock.
+void pmm_huge_account(struct pmmRegion *region, paddr_t base, size_t size, bool allocated)
+{
+	struct pmmHuge *huge = &region->huge;
+	paddr_t end = base + size;
+	paddr_t huge_end = HUGE_SLOT_ADDR(huge, huge->slot_count);
+	if (end <= huge->base || base >= huge_end) {
+		return;
+	}
+	base = base > huge->base ? base : huge->base;
+	end = end < huge_end ? end : huge_end;
+
+	for (paddr_t slot_base = ALIGN_DOWN(base, PMM_HUGE_SLOT_SIZE); slot_base < end; slot_base += PMM_HUGE_SLOT_SIZE) {
+		size_t slot = (slot_base - huge->base) / PMM_HUGE_SLOT_SIZE;
+		paddr_t from = base > slot_base ? base : slot_base;
+		paddr_t to = end < slot_base + PMM_HUGE_SLOT_SIZE ? end : slot_base + PMM_HUGE_SLOT_SIZE;
+		u16 frames = (to - from) / BASE_PAGE_SIZE;
+		if (allocated) {
+			huge->used[slot] += frames;
+			continue;
+		}
+		huge->used[slot] -= frames;
+		// The slot is entirely free again, take it back from the backend
+		if (huge->used[slot] == 0 && !HUGE_TEST(huge->pinned, slot)) {
+			pmm_huge_reform(region, slot);
+		}
+	}
+}
+
+/// Takes a mega or giga frame out of the intact slots. The caller must hold pmm.lock.
+errval_t pmm_huge_alloc_locked(size_t order, paddr_t *ret)
+{
+	if (order == PMM_HUGE_ORDER_MEGA) {
+		// Mega frames come from the top of memory, away from the slots broken for small allocations
+		struct pmmRegion *region = NULL;
+		size_t slot = 0;
+		if (!pmm_huge_find(true, &region, &slot)) {
+			return ERR_PMM_OUT_OF_MEMORY;
+		}
+		HUGE_CLEAR(region->huge.intact, slot);
+		HUGE_SET(region->huge.allocated, slot);
+		pmm.huge_free -= PMM_HUGE_SLOT_SIZE;
+		*ret = HUGE_SLOT_ADDR(&region->huge, slot);
+		pmm_frames_claim(region, *ret, PMM_HUGE_SLOT_SIZE, PMM_FRAME_HUGE);
+		return ERR_OK;
+	}
+
+	for (size_t r = pmm.region_count; r-- > 0;) {
+		struct pmmRegion *region = &pmm.regions[r];
+		struct pmmHuge *huge = &region->huge;
+		if (huge->slot_count < PMM_HUGE_GIGA_SLOTS) {
+			continue;
+		}
+		// Only the groups lying entirely inside of the slots can back a giga frame
+		paddr_t low = ALIGN_UP(huge->base, PMM_HUGE_GIGA_SIZE);
+		paddr_t high = ALIGN_DOWN(HUGE_SLOT_ADDR(huge, huge->slot_count), PMM_HUGE_GIGA_SIZE);
+		size_t groups = high > low ? (high - low) / PMM_HUGE_GIGA_SIZE : 0;
+		for (size_t g = groups; g-- > 0;) {
+			paddr_t group = low + g * PMM_HUGE_GIGA_SIZE;
+			size_t first = 0;
+			size_t last = 0;
+			if (pmm_huge_group(huge, group, &first, &last) != PMM_HUGE_GIGA_SLOTS) {
+				continue;
+			}
+			for (size_t i = first; i < last; i++) {
+				HUGE_CLEAR(huge->intact, i);
+				HUGE_SET(huge->allocated, i);
+			}
+			HUGE_SET(huge->giga, first);
+			pmm.huge_free -= PMM_HUGE_GIGA_SIZE;
+			*ret = group;
+			pmm_frames_claim(region, group, PMM_HUGE_GIGA_SIZE, PMM_FRAME_HUGE);
+			return ERR_OK;
+		}
+	}
+	return ERR_PMM_OUT_OF_MEMORY;
+}
+
+/// Returns the size of the huge frame based at base, or 0 if base does not start one.
+size_t pmm_huge_block_size(struct pmmRegion *region, paddr_t base)
+{
+	struct pmmHuge *huge = &region->huge;
+	if (base < huge->base || (base - huge->base) % PMM_HUGE_SLOT_SIZE != 0) {
+		return 0;
+	}
+	size_t slot = (base - huge->base) / PMM_HUGE_SLOT_SIZE;
+	if (slot >= huge->slot_count || !HUGE_TEST(huge->allocated, slot)) {
+		return 0;
+	}
+	if (HUGE_TEST(huge->giga, slot)) {
+		return PMM_HUGE_GIGA_SIZE;
+	}
+	// The other slots of a giga frame don't start an allocation
+	for (size_t i = slot; i-- > 0 && slot - i < PMM_HUGE_GIGA_SLOTS;) {
+		if (HUGE_TEST(huge->giga, i)) {
+			return 0;
+		}
+	}
+	return PMM_HUGE_SLOT_SIZE;
+}
+
+/// Returns a huge frame to the intact slots if base starts one, returning its size or 0. The caller must hold
+/// pmm.lock.
+size_t pmm_huge_free_locked(struct pmmRegion *region, paddr_t base)
+{
+	struct pmmHuge *huge = &region->huge;
+	size_t size = pmm_huge_block_size(region, base);
+	if (size == 0) {
+		return 0;
+	}
+	size_t slot = (base - huge->base) / PMM_HUGE_SLOT_SIZE;
+	HUGE_CLEAR(huge->giga, slot);
+	for (size_t i = slot; i < slot + size / PMM_HUGE_SLOT_SIZE; i++) {
+		HUGE_CLEAR(huge->allocated, i);
+		HUGE_SET(huge->intact, i);
+	}
+	pmm.huge_free += size;
+	return size;
+}
+
+/// Gives the intact slots overlapping [base, base + size) back to the backend for good, before the range is
+/// reserved. Fails if a huge frame was handed out of the range. The caller must hold pmm.lock.
+errval_t pmm_huge_pin(struct pmmRegion *region, paddr_t base, size_t size)
+{
+	struct pmmHuge *huge = &region->huge;
+	paddr_t huge_end = HUGE_SLOT_ADDR(huge, huge->slot_count);
+	if (base + size <= huge->base || base >= huge_end) {
+		return ERR_OK;
+	}
+	size_t first = base > huge->base ? (base - huge->base) / PMM_HUGE_SLOT_SIZE : 0;
+	size_t last = base + size < huge_end ? (ALIGN_UP(base + size, PMM_HUGE_SLOT_SIZE) - huge->base) / PMM_HUGE_SLOT_SIZE
+					      : huge->slot_count;
+	for (size_t i = first; i < last; i++) {
+		if (HUGE_TEST(huge->allocated, i)) {
+			return ERR_PMM_REGION_ALLOCATED_FROM;
+		}
+	}
+	for (size_t i = first; i < last; i++) {
+		HUGE_SET(huge->pinned, i);
+		if (!HUGE_TEST(huge->intact, i)) {
+			continue;
+		}
+		HUGE_CLEAR(huge->intact, i);
+		pmm.huge_free -= PMM_HUGE_SLOT_SIZE;
+		errval_t err = pmm_backend_release(region, HUGE_SLOT_ADDR(huge, i), PMM_HUGE_SLOT_SIZE);
+		ASSERT(err_is_ok(err), "[pmm_huge_pin] Failed to release slot %x: %s\n", HUGE_SLOT_ADDR(huge, i),
+		       err_str(err));
+		pmm.free += PMM_HUGE_SLOT_SIZE;
+	}
+	return ERR_OK;
+}
+
+/// Adds a region to the pmm. The caller must hold pmm.lock.
+errval_t pmm_add_region_locked(void *base, size_t size)
+{
+	errval_t err = err_new();
 	if (base == NULL) {
 		return ERR_NULL_ARGUMENT;
 	}
@@ -89,41 +407,65 @@ errval_t pmm_add_region(void *base, size_t size)
 	if (pmm.region_count >= PMM_REGION_COUNT) {
 		return ERR_PMM_REGION_LIST_FULL;
 	}
-	// Check if we're already managing this region
+	// Check if we're already managing any part of this region
 	for (size_t i = 0; i < pmm.region_count; i++) {
 		struct pmmRegion cur = pmm.regions[i];
-		bool UP_BOUND = aligned_base + aligned_size <= (size_t)cur.base + cur.size;
-		if (UP_BOUND) {
+		bool OVERLAPS = aligned_base < cur.base + cur.size && cur.base < aligned_base + aligned_size;
+		if (OVERLAPS) {
 			return ERR_PMM_ADD_MANAGED_REGION;
 		}
 	}
 	// Create and instantiate the region struct
-	struct pmmBlock *free_block = (struct pmmBlock *)slab_alloc(&pmm.block_allocator);
-	if (free_block == NULL) {
-		return ERR_PMM_SLAB_ALLOC_FAILED;
-	}
-	pmm.regions[pmm.region_count].base = aligned_base;
-	pmm.regions[pmm.region_count].size = aligned_size;
-	pmm.regions[pmm.region_count].free = aligned_size;
-	pmm.regions[pmm.region_count].free_blocks = free_block;
-	free_block->base = aligned_base;
-	free_block->size = aligned_size;
-	free_block->next = NULL;
+	struct pmmRegion *region = &pmm.regions[pmm.region_count];
+	region->base = aligned_base;
+	region->size = aligned_size;
+	region->free = aligned_size;
+	region->metadata = 0;
+	region->largest_free = aligned_size;
+	region->free_blocks = NULL;
+	region->size_tree = NULL;
+	region->alloc_tree = NULL;
+	switch (pmm.policy) {
+	case PMM_POLICY_FIRST_FIT:
+	case PMM_POLICY_BEST_FIT:
+	case PMM_POLICY_WORST_FIT:
+		if (err_is_fail((err = pmm_extent_region_init(region)))) {
+			return err;
+		}
+		break;
+	case PMM_POLICY_BUDDY:
+		if (err_is_fail((err = pmm_buddy_region_init(region)))) {
+			return err;
+		}
+		break;
+	case PMM_POLICY_BITMAP:
+		if (err_is_fail((err = pmm_bitmap_region_init(region)))) {
+			return err;
+		}
+		break;
+	}
+	if (err_is_fail((err = pmm_frames_region_init(region)))) {
+		if (region->free_blocks != NULL) {
+			pmm_extent_region_release(region);
+		}
+		return err;
+	}
 	pmm.region_count++;
 	// Update the pmm's usage statistics
 	pmm.total += aligned_size;
-	pmm.free += aligned_size;
+	pmm.free += region->free;
+	// Keep the naturally aligned 2 MiB slots whole until small allocations run out of other memory
+	pmm_huge_region_init(region);
 	return ERR_OK;
 }
 
-errval_t pmm_remove_region(paddr_t base, size_t size)
+/// Removes a region from the pmm. The caller must hold pmm.lock.
+errval_t pmm_remove_region_locked(paddr_t base, size_t size)
 {
+	errval_t err = err_new();
 	paddr_t aligned_base = ALIGN_DOWN(base, BASE_PAGE_SIZE);
-	size_t aligned_size = ALIGN_UP(size, BASE_PAGE_SIZE);
+	size_t aligned_size = ALIGN_UP(base + size, BASE_PAGE_SIZE) - aligned_base;
 
-	// Check that the aligned base and size region is at least BASE_PAGE_SIZE
-	bool ALIGNED_REGION_FITS = aligned_base + aligned_size <= base + size;
-	ASSERT(ALIGNED_REGION_FITS, "Aligned region does not fit in the original region");
 	bool NEW_SIZE_NON_ZERO = aligned_size >= BASE_PAGE_SIZE;
 	if (!NEW_SIZE_NON_ZERO) {
 		return ERR_OK;
@@ -135,82 +477,335 @@ errval_t pmm_remove_region(paddr_t base, size_t size)
 		bool EXACT_FIT = aligned_base == region->base && aligned_size == region->size;
 		if (EXACT_FIT) {
 			// If the region has not been allocated from we can remove it safely
-			if (region->free != region->size) {
+			size_t intact = 0;
+			for (size_t w = 0; w < PMM_HUGE_WORDS; w++) {
+				intact += bit_popcount(region->huge.intact[w]) * PMM_HUGE_SLOT_SIZE;
+			}
+			if (region->free + region->metadata + intact != region->size) {
 				return ERR_PMM_REGION_ALLOCATED_FROM;
 			}
 			// Free up and clean this region then shift the rest of the regions down
-			slab_free(&pmm.block_allocator, region->free_blocks);
-			pmm.free -= region->size;
+			if (region->free_blocks != NULL) {
+				pmm_extent_region_release(region);
+			}
+			pmm.free -= region->free;
+			pmm.huge_free -= intact;
+			pmm.frame_db -= ALIGN_UP(region->size / BASE_PAGE_SIZE * sizeof(struct pmmFrame), BASE_PAGE_SIZE);
 			pmm.total -= region->size;
 			// Remove the region by shifting the rest of the regions down
 			for (size_t j = i; j < pmm.region_count - 1; j++) {
 				pmm.regions[j] = pmm.regions[j + 1];
 			}
+			pmm.region_count--;
 			return ERR_OK;
-
 		}
 		bool UNDER_BOUND_REGION = aligned_base >= region->base;
 		bool UP_BOUND_REGION = aligned_base + aligned_size <= region->base + region->size;
 		if (UNDER_BOUND_REGION && UP_BOUND_REGION) {
-			// Search in the free blocks of the region for the block to remove
-			struct pmmBlock *block = region->free_blocks;
-			struct pmmBlock *prev = NULL;
-			while (block != NULL) {
-				bool UNDER_BOUND = aligned_base >= block->base;
-				bool UP_BOUND = aligned_base + aligned_size <= block->base + block->size;
-				if (UNDER_BOUND && UP_BOUND) {
-					size_t offset = aligned_base - block->base;
-
-					// Check if the current pmmBlock has at least a page preceeding or postceeding
-					bool EXISTS_PRECEEDING = block->base != aligned_base;
-					bool EXISTS_POSTCEEDING = block->base + block->size > aligned_base + aligned_size;
-					if (EXISTS_PRECEEDING && EXISTS_POSTCEEDING) {
-						// Need to make a new block
-						block->size = offset;
-
-						struct pmmBlock *extra = slab_alloc(&pmm.block_allocator);
-						if (extra == NULL) {
-							return ERR_PMM_SLAB_ALLOC_FAILED;
-						}
-						extra->base = aligned_base + aligned_size;
-						extra->size = block->base + block->size - (aligned_base + aligned_size);
-						extra->next = block->next;
-						block->next = extra;
-					} else if (EXISTS_PRECEEDING) {
-						block->size = offset;
-					} else if (EXISTS_POSTCEEDING) {
-						block->base = aligned_base + aligned_size;
-						block->size = block->base + block->size - (aligned_base + aligned_size);
-					} else if (prev == NULL) {
-						// This is the first block in the region, so we can just remove it
-						region->free_blocks = block->next;
-						slab_free(&pmm.block_allocator, block);
-					} else {
-						prev->next = block->next;
-						slab_free(&pmm.block_allocator, block);
-					}
+			if (err_is_fail((err = pmm_huge_pin(region, aligned_base, aligned_size)))) {
+				return err;
+			}
+			if (err_is_fail((err = pmm_backend_reserve(region, aligned_base, aligned_size)))) {
+				return err;
+			}
+			pmm_frames_mark(region, aligned_base, aligned_size, PMM_FRAME_RESERVED);
+			pmm.free -= aligned_size;
+			return ERR_OK;
+		}
+	}
+
+	return ERR_PMM_REGION_NOT_MANAGED;
+}
+
+/// Allocates size bytes from the first region able to hold them, breaking intact huge frame slots only once the
+/// backends are out of memory. Should that not help either, the slots are reformed. The caller must hold pmm.lock.
+errval_t pmm_alloc_locked(size_t size, size_t alignment, paddr_t *ret)
+{
+	// Check that the allocator has enough memory
+	if (pmm.free + pmm.huge_free < size) {
+		return ERR_PMM_OUT_OF_MEMORY;
+	}
+
+	size_t broken = 0;
+	for (;; broken++) {
+		for (size_t i = 0; i < pmm.region_count; i++) {
+			struct pmmRegion *region = &pmm.regions[i];
+			// Does this region have a free extent big enough for the request, if not early exit
+			if (region->largest_free < size) {
+				continue;
+			}
 
-					pmm.regions[i].free -= aligned_size;
-					pmm.free -= aligned_size;
-					return ERR_OK;
-				} else if (UP_BOUND) {
-					// We've gone past the block we are looking for, so we can stop searching
-					return ERR_PMM_REGION_ALLOCATED_FROM;
+			// Find a large enough block as per our allocation policy:
+			errval_t err = ERR_OK;
+			size_t allocated = size;
+			switch (pmm.policy) {
+			case PMM_POLICY_FIRST_FIT:
+			case PMM_POLICY_BEST_FIT:
+			case PMM_POLICY_WORST_FIT:
+				err = pmm_extent_alloc(region, size, alignment, pmm.policy, ret);
+				break;
+			case PMM_POLICY_BUDDY:
+				err = pmm_buddy_alloc(region, size, alignment, ret, &allocated);
+				break;
+			case PMM_POLICY_BITMAP:
+				err = pmm_bitmap_alloc(region, size, alignment, ret);
+				break;
+			}
+			if (err_is_ok(err)) {
+				pmm.free -= allocated;
+				pmm_huge_account(region, *ret, allocated, true);
+				pmm_frames_claim(region, *ret, allocated, 0);
+				return ERR_OK;
+			}
+		}
+		if (!pmm_huge_break()) {
+			break;
+		}
+	}
+
+	// No large enough block was found. Slots broken in vain (say for a huge frame fallback or an alignment no extent
+	// meets) only reform on the free path, which they would never see.
+	if (broken != 0) {
+		pmm_huge_mend();
+	}
+	return ERR_PMM_OUT_OF_MEMORY;
+}
+
+/// Returns the block based at base to its region. The caller must hold pmm.lock.
+errval_t pmm_free_locked(paddr_t base)
+{
+	errval_t err = err_new();
+	struct pmmRegion *region = pmm_find_region(base);
+	if (region == NULL) {
+		return ERR_PMM_REGION_NOT_MANAGED;
+	}
+	ASSERT(region->frames[PMM_PFN(base) - PMM_PFN(region->base)].refcount <= 1,
+	       "[pmm_free_locked] Freeing %x with references left.\n", base);
+	// Huge frames go back to the intact slots rather than to the backend
+	size_t freed = pmm_huge_free_locked(region, base);
+	if (freed != 0) {
+		pmm_frames_mark(region, base, freed, PMM_FRAME_FREE);
+		return ERR_OK;
+	}
+
+	switch (pmm.policy) {
+	case PMM_POLICY_FIRST_FIT:
+	case PMM_POLICY_BEST_FIT:
+	case PMM_POLICY_WORST_FIT:
+		err = pmm_extent_free(region, base, &freed);
+		break;
+	case PMM_POLICY_BUDDY:
+		err = pmm_buddy_free(region, base, &freed);
+		break;
+	case PMM_POLICY_BITMAP:
+		err = pmm_bitmap_free(region, base, &freed);
+		break;
+	}
+	if (err_is_fail(err)) {
+		return err;
+	}
+	pmm.free += freed;
+	pmm_frames_mark(region, base, freed, PMM_FRAME_FREE);
+	pmm_huge_account(region, base, freed, false);
+	return ERR_OK;
+}
+
+/// Returns the size of the allocation based at base, or 0 if base does not start an allocation. The caller must hold
+/// pmm.lock, the magazines fill from and drain into the backends concurrently.
+size_t pmm_block_size_locked(paddr_t base)
+{
+	struct pmmRegion *region = pmm_find_region(base);
+	if (region == NULL) {
+		return 0;
+	}
+	size_t huge_size = pmm_huge_block_size(region, base);
+	if (huge_size != 0) {
+		return huge_size;
+	}
+	switch (pmm.policy) {
+	case PMM_POLICY_FIRST_FIT:
+	case PMM_POLICY_BEST_FIT:
+	case PMM_POLICY_WORST_FIT:
+		return pmm_extent_block_size(region, base);
+	case PMM_POLICY_BUDDY:
+		return pmm_buddy_block_size(region, base);
+	case PMM_POLICY_BITMAP:
+		return pmm_bitmap_block_size(region, base);
+	}
+	return 0;
+}
+
+size_t pmm_block_size(paddr_t base)
+{
+	spinlock_acquire(&pmm.lock);
+	size_t size = pmm_block_size_locked(base);
+	spinlock_release(&pmm.lock);
+	return size;
+}
+
+/// Allocates up to count single frames in one pass over the regions, returning how many were handed out. The caller
+/// must hold pmm.lock.
+size_t pmm_alloc_batch_locked(size_t count, void **frames)
+{
+	paddr_t batch[PMM_BATCH_CHUNK];
+	size_t allocated = 0;
+	do {
+		for (size_t i = 0; i < pmm.region_count && allocated < count; i++) {
+			struct pmmRegion *region = &pmm.regions[i];
+			while (allocated < count && region->largest_free >= BASE_PAGE_SIZE) {
+				size_t wanted = count - allocated < PMM_BATCH_CHUNK ? count - allocated : PMM_BATCH_CHUNK;
+				size_t got = 0;
+				switch (pmm.policy) {
+				case PMM_POLICY_FIRST_FIT:
+				case PMM_POLICY_BEST_FIT:
+				case PMM_POLICY_WORST_FIT:
+					got = pmm_extent_alloc_batch(region, batch, wanted);
+					break;
+				case PMM_POLICY_BUDDY:
+					got = pmm_buddy_alloc_batch(region, batch, wanted);
+					break;
+				case PMM_POLICY_BITMAP:
+					got = pmm_bitmap_alloc_batch(region, batch, wanted);
+					break;
+				}
+				for (size_t j = 0; j < got; j++) {
+					pmm_huge_account(region, batch[j], BASE_PAGE_SIZE, true);
+					frames[allocated++] = (void *)batch[j];
+				}
+				pmm.free -= got * BASE_PAGE_SIZE;
+				if (got < wanted) {
+					break;
 				}
-				prev = block;
-				block = block->next;
 			}
 		}
+	} while (allocated < count && pmm_huge_break());
+	return allocated;
+}
+
+/// Returns count single frames to the backends without looking at their descriptors, for frames that are allocated in
+/// the backends but were never claimed (magazine contents, rolled back batches). The caller must hold pmm.lock.
+void pmm_free_batch_locked(size_t count, void **frames)
+{
+	for (size_t i = 0; i < count; i++) {
+		errval_t err = pmm_free_locked((paddr_t)frames[i]);
+		ASSERT(err_is_ok(err), "[pmm_free_batch_locked] Failed to return page %x: %s\n", frames[i],
+		       err_str(err));
 	}
+}
 
-	return ERR_PMM_REGION_NOT_MANAGED;
+/// Grows the pmmBlock slab with a frame of the pmm itself. Only ever called from slab_alloc, which the backends run
+/// under pmm.lock, so the frame is taken with pmm_alloc_locked.
+errval_t pmm_block_refill(struct slabAllocator *slabs)
+{
+	paddr_t base = 0;
+	errval_t err = pmm_alloc_locked(BASE_PAGE_SIZE, BASE_PAGE_SIZE, &base);
+	if (err_is_fail(err)) {
+		return err;
+	}
+	pmm_frame(base)->type = PMM_FRAME_SLAB;
+	return slab_grow(slabs, (void *)base, BASE_PAGE_SIZE);
 }
 
-errval_t pmm_alloc_aligned(size_t size, size_t alignment, u8 **ret)
+/// Hands an empty pmmBlock slab page back to the pmm. Only ever called from slab_reclaim, which pmm_reclaim runs under
+/// pmm.lock. The initial static buffer is not managed by the pmm and stays with the slab.
+errval_t pmm_block_release(struct slabAllocator *slabs, void *buf)
 {
+	(void)slabs;
+	return pmm_free_locked((paddr_t)buf);
+}
+
+/// Refills a hart's page magazine with single frames from the backends.
+size_t pmm_page_fill(void *ctx, void **pages, size_t count)
+{
+	(void)ctx;
+	spinlock_acquire(&pmm.lock);
+	size_t filled = pmm_alloc_batch_locked(count, pages);
+	spinlock_release(&pmm.lock);
+	return filled;
+}
+
+/// Drains frames from a hart's page magazine back to the backends.
+void pmm_page_drain(void *ctx, void **pages, size_t count)
+{
+	(void)ctx;
+	spinlock_acquire(&pmm.lock);
+	pmm_free_batch_locked(count, pages);
+	spinlock_release(&pmm.lock);
+}
+
+errval_t pmm_add_region(void *base, size_t size)
+{
+	spinlock_acquire(&pmm.lock);
+	errval_t err = pmm_add_region_locked(base, size);
+	spinlock_release(&pmm.lock);
+	return err;
+}
+
+errval_t pmm_remove_region(paddr_t base, size_t size)
+{
+	spinlock_acquire(&pmm.lock);
+	errval_t err = pmm_remove_region_locked(base, size);
+	spinlock_release(&pmm.lock);
+	return err;
+}
+
+/// Pops a zeroed frame off the zero pool, or returns NULL if it is empty.
+u8 *pmm_zero_pool_pop(void)
+{
+	struct pmmZeroPool *pool = &pmm.zero_pool;
+	spinlock_acquire(&pool->lock);
+	struct pmmZeroFrame *frame = pool->frames;
+	if (frame != NULL) {
+		pool->frames = frame->next;
+		pool->stats.pooled--;
+		pool->stats.hits++;
+	} else {
+		pool->stats.misses++;
+	}
+	spinlock_release(&pool->lock);
+
+	if (frame != NULL) {
+		// The link was the only non-zero word of the frame
+		frame->next = NULL;
+	}
+	return (u8 *)frame;
+}
+
+/// Hands the frames parked in the zero pool, the page caches and the empty pmmBlock slab pages back to the backends.
+size_t pmm_reclaim(void)
+{
+	struct pmmZeroPool *pool = &pmm.zero_pool;
+	spinlock_acquire(&pool->lock);
+	struct pmmZeroFrame *frames = pool->frames;
+	size_t reclaimed = pool->stats.pooled;
+	pool->frames = NULL;
+	pool->stats.pooled = 0;
+	spinlock_release(&pool->lock);
+
+	spinlock_acquire(&pmm.lock);
+	while (frames != NULL) {
+		struct pmmZeroFrame *next = frames->next;
+		errval_t err = pmm_free_locked((paddr_t)frames);
+		ASSERT(err_is_ok(err), "[pmm_reclaim] Failed to return zeroed page %x: %s\n", frames, err_str(err));
+		frames = next;
+	}
+	spinlock_release(&pmm.lock);
+	// The magazines drain under pmm.lock themselves
+	reclaimed += magazine_reclaim(&pmm.page_cache);
+
+	// Only then the empty pmmBlock slab pages go back, in the extent policies the blocks of the drained frames just
+	// coalesced and emptied them
+	spinlock_acquire(&pmm.lock);
+	reclaimed += slab_reclaim(&pmm.block_allocator);
+	spinlock_release(&pmm.lock);
+	return reclaimed;
+}
+
+errval_t pmm_alloc_flags(size_t size, size_t alignment, u32 flags, u8 **ret)
+{
+	errval_t err = err_new();
 	// Check for null arguments
 	if (ret == NULL) {
-		*ret = NULL;
 		return ERR_NULL_ARGUMENT;
 	}
 
@@ -222,117 +817,277 @@ errval_t pmm_alloc_aligned(size_t size, size_t alignment, u8 **ret)
 
 	// Round up the size to the nearest multiple of BASE_PAGE_SIZE
 	size = ALIGN_UP(size, BASE_PAGE_SIZE);
+	bool ZERO = (flags & PMM_ALLOC_NO_ZERO) == 0;
 
-	// Check that the allocator has enough memory
-	if (pmm.free < size) {
+	if (size == BASE_PAGE_SIZE && alignment == BASE_PAGE_SIZE) {
+		// Zeroed single frames are taken from the zero pool first
+		if (ZERO && (*ret = pmm_zero_pool_pop()) != NULL) {
+			pmm_frames_claim(pmm_find_region((paddr_t)*ret), (paddr_t)*ret, BASE_PAGE_SIZE, 0);
+			return ERR_OK;
+		}
+		// Single frames come out of the current hart's magazines
+		*ret = magazine_alloc(&pmm.page_cache);
+		if (*ret == NULL && pmm_reclaim() > 0) {
+			*ret = magazine_alloc(&pmm.page_cache);
+		}
+		err = *ret == NULL ? ERR_PMM_OUT_OF_MEMORY : ERR_OK;
+		if (err_is_ok(err)) {
+			pmm_frames_claim(pmm_find_region((paddr_t)*ret), (paddr_t)*ret, BASE_PAGE_SIZE, 0);
+		}
+	} else {
+		paddr_t base = 0;
+		spinlock_acquire(&pmm.lock);
+		err = pmm_alloc_locked(size, alignment, &base);
+		spinlock_release(&pmm.lock);
+		// Under memory pressure the frames parked in the page caches may make the difference
+		if (err_is_fail(err) && pmm_reclaim() > 0) {
+			spinlock_acquire(&pmm.lock);
+			err = pmm_alloc_locked(size, alignment, &base);
+			spinlock_release(&pmm.lock);
+		}
+		*ret = (u8 *)base;
+	}
+	if (err_is_fail(err)) {
 		*ret = NULL;
-		return ERR_PMM_OUT_OF_MEMORY;
+		return err;
+	}
+
+	if (ZERO) {
+		clear_pages(*ret, size / BASE_PAGE_SIZE);
+	}
+	return ERR_OK;
+}
+
+errval_t pmm_alloc_aligned(size_t size, size_t alignment, u8 **ret)
+{
+	return pmm_alloc_flags(size, alignment, 0, ret);
+}
+
+errval_t pmm_alloc(size_t size, u8 **ret)
+{
+	return pmm_alloc_aligned(size, BASE_PAGE_SIZE, ret);
+}
+
+errval_t pmm_alloc_huge(size_t order, u32 flags, u8 **ret)
+{
+	if (ret == NULL) {
+		return ERR_NULL_ARGUMENT;
+	}
+	if (order != PMM_HUGE_ORDER_MEGA && order != PMM_HUGE_ORDER_GIGA) {
+		*ret = NULL;
+		return ERR_PMM_BAD_HUGE_ORDER;
+	}
+
+	size_t size = (size_t)BASE_PAGE_SIZE << order;
+	paddr_t base = 0;
+	spinlock_acquire(&pmm.lock);
+	errval_t err = pmm_huge_alloc_locked(order, &base);
+	spinlock_release(&pmm.lock);
+	// Without an intact slot the backends may still find a naturally aligned extent
+	if (err_is_fail(err)) {
+		return pmm_alloc_flags(size, size, flags, ret);
 	}
 
-	// Check whether we need to refill the slab Allocator
-	//
-	// For this we probably need paging to work!
-	// TODO
-	if (slab_freecount(&pmm.block_allocator) < 16) {
-		TODO("Slab allocator needs to be refilled, but paging is not implemented yet.");
+	*ret = (u8 *)base;
+	if ((flags & PMM_ALLOC_NO_ZERO) == 0) {
+		clear_pages(*ret, size / BASE_PAGE_SIZE);
+	}
+	return ERR_OK;
+}
+
+errval_t pmm_free(u8 *ret)
+{
+	if (ret == NULL) {
+		return ERR_NULL_ARGUMENT;
 	}
 
-	// Find a large enough region as per our allocation policy:
+	spinlock_acquire(&pmm.lock);
+	// Frames parked in the magazines still count as allocated in the backends, only their descriptors tell them
+	// apart from allocations, which catches double frees of single frames
+	struct pmmRegion *region = pmm_find_region((paddr_t)ret);
+	if (region != NULL && region->frames[PMM_PFN(ret) - PMM_PFN(region->base)].type == PMM_FRAME_FREE) {
+		spinlock_release(&pmm.lock);
+		return ERR_PMM_INVALID_FREE;
+	}
+
+	// Single frames go back into the current hart's magazines
+	if (pmm_block_size_locked((paddr_t)ret) == BASE_PAGE_SIZE) {
+		ASSERT(region->frames[PMM_PFN(ret) - PMM_PFN(region->base)].refcount <= 1,
+		       "[pmm_free] Freeing %x with references left.\n", ret);
+		pmm_frames_mark(region, (paddr_t)ret, BASE_PAGE_SIZE, PMM_FRAME_FREE);
+		spinlock_release(&pmm.lock);
+		magazine_free(&pmm.page_cache, ret);
+		return ERR_OK;
+	}
+
+	errval_t err = pmm_free_locked((paddr_t)ret);
+	spinlock_release(&pmm.lock);
+	return err;
+}
+
+errval_t pmm_extend(u8 *base, size_t size)
+{
+	if (base == NULL) {
+		return ERR_NULL_ARGUMENT;
+	}
+	size = ALIGN_UP(size, BASE_PAGE_SIZE);
+
+	spinlock_acquire(&pmm.lock);
+	struct pmmRegion *region = pmm_find_region((paddr_t)base);
+	if (region == NULL) {
+		spinlock_release(&pmm.lock);
+		return ERR_PMM_REGION_NOT_MANAGED;
+	}
+	// Huge frames are handed out whole
+	if (pmm_huge_block_size(region, (paddr_t)base) != 0) {
+		spinlock_release(&pmm.lock);
+		return ERR_PMM_CANNOT_EXTEND;
+	}
+
+	errval_t err = ERR_PMM_CANNOT_EXTEND;
+	size_t old_size = 0;
 	switch (pmm.policy) {
 	case PMM_POLICY_FIRST_FIT:
-		break;
 	case PMM_POLICY_BEST_FIT:
 	case PMM_POLICY_WORST_FIT:
-		*ret = NULL;
-		return ERR_NOT_IMPLEMENTED;
+		err = pmm_extent_extend(region, (paddr_t)base, size, &old_size);
+		break;
+	case PMM_POLICY_BUDDY:
+		// Buddy blocks are naturally aligned powers of two, they only grow by merging with a free buddy of the
+		// same order, which is rarely free right after an allocation.
+		old_size = pmm_buddy_block_size(region, (paddr_t)base);
+		err = (old_size != 0 && old_size >= size) ? ERR_OK : ERR_PMM_CANNOT_EXTEND;
+		size = old_size;
+		break;
+	case PMM_POLICY_BITMAP:
+		err = pmm_bitmap_extend(region, (paddr_t)base, size, &old_size);
+		break;
 	}
+	if (err_is_ok(err) && size > old_size) {
+		struct pmmFrame *head = &region->frames[PMM_PFN(base) - PMM_PFN(region->base)];
+		pmm.free -= size - old_size;
+		pmm_huge_account(region, (paddr_t)base + old_size, size - old_size, true);
+		pmm_frames_mark(region, (paddr_t)base + old_size, size - old_size, head->type);
+	}
+	spinlock_release(&pmm.lock);
+	return err;
+}
 
-	ASSERT(pmm.policy == PMM_POLICY_FIRST_FIT, "Starting by implementing only First Fit policy");
-	for (size_t i = 0; i < pmm.region_count; i++)
-	// for (struct pmmRegion* region = pmm.regions; region != NULL; region = region->next)
-	{
-		struct pmmRegion region = pmm.regions[i];
-		// Is this regions's free pool big enough for the requuest, if not early exit
-		if (region.free < size) {
-			continue;
-		}
+errval_t pmm_alloc_batch(size_t count, u8 **frames)
+{
+	if (frames == NULL) {
+		return ERR_NULL_ARGUMENT;
+	}
 
-		struct pmmBlock *block = region.free_blocks;
-		struct pmmBlock *prev = NULL;
-		while (block != NULL) {
-			size_t block_size = block->size;
-			size_t block_base = block->base;
-
-			size_t aligned_base = ALIGN_UP(block_base, alignment);
-			bool SIZE_OK = block_base + block_size >= aligned_base + size;
-			if (SIZE_OK) {
-				size_t offset = aligned_base - block_base;
-
-				// Check if the current pmmBlock has atleast a page preceeding or postceeding
-				bool EXISTS_PRECEEDING = block_base != aligned_base;
-				bool EXISTS_POSTCEEDING = block_base + block_size > aligned_base + size;
-				if (EXISTS_PRECEEDING && EXISTS_POSTCEEDING) {
-					// Need to make a new block
-					block->size = offset;
-
-					struct pmmBlock *extra = slab_alloc(&pmm.block_allocator);
-					extra->base = aligned_base + size;
-					extra->size = block_base + block_size - (aligned_base + size);
-					extra->next = block->next;
-					block->next = extra;
-				} else if (EXISTS_PRECEEDING) {
-					block->size = offset;
-				} else if (EXISTS_POSTCEEDING) {
-					block->base = aligned_base + size;
-					block->size = block_base + block_size - (aligned_base + size);
-				} else if (prev == NULL) {
-					// This is the first block in the region, so we can just remove it
-					pmm.regions[i].free_blocks = block->next;
-					slab_free(&pmm.block_allocator, block);
-				} else {
-					prev->next = block->next;
-					slab_free(&pmm.block_allocator, block);
-				}
+	spinlock_acquire(&pmm.lock);
+	size_t allocated = pmm_alloc_batch_locked(count, (void **)frames);
+	spinlock_release(&pmm.lock);
+	// Under memory pressure the frames parked in the page caches may make the difference
+	if (allocated < count && pmm_reclaim() > 0) {
+		spinlock_acquire(&pmm.lock);
+		allocated += pmm_alloc_batch_locked(count - allocated, (void **)&frames[allocated]);
+		spinlock_release(&pmm.lock);
+	}
+	if (allocated < count) {
+		// The frames are not claimed yet, their descriptors still say FREE
+		spinlock_acquire(&pmm.lock);
+		pmm_free_batch_locked(allocated, (void **)frames);
+		spinlock_release(&pmm.lock);
+		return ERR_PMM_OUT_OF_MEMORY;
+	}
 
-				pmm.regions[i].free -= size;
-				pmm.free -= size;
-				*ret = (u8 *)aligned_base;
+	for (size_t i = 0; i < count; i++) {
+		pmm_frames_claim(pmm_find_region((paddr_t)frames[i]), (paddr_t)frames[i], BASE_PAGE_SIZE, 0);
+		clear_page(frames[i]);
+	}
+	return ERR_OK;
+}
 
-#define ZERO_OUT_PMM_PAGE
-#ifdef ZERO_OUT_PMM_PAGE
-				// Zero out the page being given out
-				memset(*ret, 0, size);
-#endif
-				return ERR_OK;
-			}
+errval_t pmm_free_batch(size_t count, u8 **frames)
+{
+	if (frames == NULL) {
+		return ERR_NULL_ARGUMENT;
+	}
 
-			prev = block;
-			block = block->next;
+	// The frames go straight back to the backends, the batch would only overflow the page caches
+	errval_t err = ERR_OK;
+	spinlock_acquire(&pmm.lock);
+	for (size_t i = 0; i < count; i++) {
+		// Like in pmm_free, a FREE descriptor marks a frame parked in a magazine or the zero pool, which the
+		// backend still counts as allocated and would hand out a second time
+		struct pmmFrame *frame = pmm_frame((paddr_t)frames[i]);
+		errval_t frame_err = ERR_PMM_INVALID_FREE;
+		if (frame == NULL || frame->type != PMM_FRAME_FREE) {
+			frame_err = pmm_free_locked((paddr_t)frames[i]);
+		}
+		if (err_is_fail(frame_err) && err_is_ok(err)) {
+			err = frame_err;
 		}
 	}
+	spinlock_release(&pmm.lock);
+	return err;
+}
 
-	// No large enough block was found.
-	*ret = NULL;
-	return ERR_PMM_OUT_OF_MEMORY;
+size_t pmm_total_mem(void)
+{
+	return pmm.total;
 }
 
-errval_t pmm_alloc(size_t size, u8 **ret)
+size_t pmm_free_mem(void)
 {
-	return pmm_alloc_aligned(size, BASE_PAGE_SIZE, ret);
+	return pmm.free + pmm.huge_free;
 }
 
-errval_t pmm_free(u8 *ret)
+size_t pmm_huge_mem(void)
 {
-	(void)ret;
-	return ERR_NOT_IMPLEMENTED;
+	return pmm.huge_free;
 }
 
-size_t pmm_total_mem(void)
+size_t pmm_cached_mem(void)
 {
-	return pmm.total;
+	return magazine_cached(&pmm.page_cache) * BASE_PAGE_SIZE;
 }
 
-size_t pmm_free_mem(void)
+size_t pmm_zero_pool_refill(size_t budget)
+{
+	struct pmmZeroPool *pool = &pmm.zero_pool;
+	size_t refilled = 0;
+	for (; refilled < budget; refilled++) {
+		if (pool->stats.pooled >= PMM_ZERO_POOL_TARGET) {
+			break;
+		}
+		struct pmmZeroFrame *frame = magazine_alloc(&pmm.page_cache);
+		if (frame == NULL) {
+			break;
+		}
+		// Zero the frame outside of the lock, allocations keep being served meanwhile
+		clear_page(frame);
+
+		spinlock_acquire(&pool->lock);
+		frame->next = pool->frames;
+		pool->frames = frame;
+		pool->stats.pooled++;
+		pool->stats.refills++;
+		spinlock_release(&pool->lock);
+	}
+	return refilled;
+}
+
+void pmm_zero_pool_stats(struct pmmZeroPoolStats *stats)
+{
+	spinlock_acquire(&pmm.zero_pool.lock);
+	*stats = pmm.zero_pool.stats;
+	spinlock_release(&pmm.zero_pool.lock);
+}
+
+void pmm_print_stats(void)
 {
-	return pmm.free;
+	struct pmmZeroPoolStats zero;
+	pmm_zero_pool_stats(&zero);
+	println("[pmm] total: %x bytes, free: %x bytes, cached in magazines: %x bytes", pmm_total_mem(), pmm_free_mem(),
+		pmm_cached_mem());
+	println("[pmm] intact huge frames: %x bytes, frame database: %x bytes", pmm_huge_mem(), pmm_frame_db_mem());
+	println("[pmm] zero pool: %d frames, hits: %d, misses: %d, refills: %d", zero.pooled, zero.hits, zero.misses,
+		zero.refills);
+	magazine_print_stats(&pmm.page_cache);
 }
@@ -0,0 +1,247 @@
+// Bitmap backend for the physical memory manager.
+//
+// Every region tracks its frames with one bit each, searches for free runs are done a 64-bit word at a time with
+// count-trailing-zeros. A second bitmap marks the last frame of every allocation, which is all pmm_free needs to
+// find the extent of a block. A third bitmap marks the reserved frames, the bitmaps themselves and the ranges taken
+// out with pmm_bitmap_reserve, which are used without being an allocation that could be freed. Unlike the pmmBlock
+// lists the metadata never grows: three bits per frame, carved from the front of the region when it is added.
+#include <octiron/pmm_internal.h>
+
+#include <kzadhbat/assert.h>
+#include <kzadhbat/bitmacros.h>
+#include <kzadhbat/libc/string.h>
+
+#define BITMAP_WORD(i) ((i) / 64)
+#define BITMAP_BIT(i) ((u64)1 << ((i) % 64))
+#define BITMAP_TEST(map, i) (((map)[BITMAP_WORD(i)] & BITMAP_BIT(i)) != 0)
+
+/// Returns the index of the first frame in [from, to) whose bit equals value, or to if there is none.
+size_t bitmap_find(const u64 *map, size_t from, size_t to, bool value)
+{
+	size_t i = from;
+	while (i < to) {
+		u64 word = value ? map[BITMAP_WORD(i)] : ~map[BITMAP_WORD(i)];
+		// Ignore the bits below i in the first word
+		word &= ~(BITMAP_BIT(i) - 1);
+		if (word != 0) {
+			size_t found = ALIGN_DOWN(i, 64) + bit_ctz(word);
+			return found < to ? found : to;
+		}
+		i = ALIGN_DOWN(i, 64) + 64;
+	}
+	return to;
+}
+
+/// Sets or clears the bits of the frames [from, to).
+void bitmap_fill(u64 *map, size_t from, size_t to, bool value)
+{
+	while (from < to) {
+		size_t word_end = ALIGN_DOWN(from, 64) + 64;
+		size_t end = word_end < to ? word_end : to;
+		u64 mask = (end - from == 64) ? ~(u64)0 : ((BITMAP_BIT(end - from) - 1) << (from % 64));
+		if (value) {
+			map[BITMAP_WORD(from)] |= mask;
+		} else {
+			map[BITMAP_WORD(from)] &= ~mask;
+		}
+		from = end;
+	}
+}
+
+/// Marks [from, to) as a single allocation.
+void bitmap_mark(struct pmmRegion *region, size_t from, size_t to)
+{
+	bitmap_fill(region->bitmap.used, from, to, true);
+	region->bitmap.ends[BITMAP_WORD(to - 1)] |= BITMAP_BIT(to - 1);
+	if (from == region->bitmap.hint) {
+		region->bitmap.hint = bitmap_find(region->bitmap.used, to, region->bitmap.frame_count, false);
+	}
+}
+
+/// Marks [from, to) as reserved.
+void bitmap_reserve(struct pmmRegion *region, size_t from, size_t to)
+{
+	bitmap_fill(region->bitmap.used, from, to, true);
+	bitmap_fill(region->bitmap.reserved, from, to, true);
+	if (from == region->bitmap.hint) {
+		region->bitmap.hint = bitmap_find(region->bitmap.used, to, region->bitmap.frame_count, false);
+	}
+}
+
+errval_t pmm_bitmap_region_init(struct pmmRegion *region)
+{
+	size_t frame_count = region->size / BASE_PAGE_SIZE;
+	size_t words = ALIGN_UP(frame_count, 64) / 64;
+
+	// The bitmaps are carved out of the front of the region itself
+	size_t metadata = ALIGN_UP(3 * words * sizeof(u64), BASE_PAGE_SIZE);
+	if (metadata >= region->size) {
+		return ERR_PMM_ADD_REGION_TOO_SMALL;
+	}
+	region->bitmap.used = (u64 *)region->base;
+	region->bitmap.ends = region->bitmap.used + words;
+	region->bitmap.reserved = region->bitmap.ends + words;
+	region->bitmap.frame_count = frame_count;
+	region->bitmap.hint = 0;
+	memset(region->bitmap.used, 0, 3 * words * sizeof(u64));
+
+	// The padding bits past the last frame are never free
+	bitmap_fill(region->bitmap.used, frame_count, words * 64, true);
+	bitmap_reserve(region, 0, metadata / BASE_PAGE_SIZE);
+
+	region->metadata = metadata;
+	region->free = region->size - metadata;
+	// Finding the longest free run is as expensive as an allocation, the free count is bound enough
+	region->largest_free = region->free;
+	return ERR_OK;
+}
+
+errval_t pmm_bitmap_alloc(struct pmmRegion *region, size_t size, size_t alignment, paddr_t *ret)
+{
+	struct pmmBitmap *bitmap = &region->bitmap;
+	size_t count = size / BASE_PAGE_SIZE;
+	u64 first = PMM_PFN(region->base);
+	u64 align = alignment / BASE_PAGE_SIZE;
+
+	size_t i = bitmap->hint;
+	while (i + count <= bitmap->frame_count) {
+		// Skip to the next free frame and align it in physical memory
+		i = bitmap_find(bitmap->used, i, bitmap->frame_count, false);
+		i = ALIGN_UP(first + i, align) - first;
+		if (i + count > bitmap->frame_count) {
+			break;
+		}
+		// The run fits if there is no allocated frame inside of it
+		size_t used = bitmap_find(bitmap->used, i, i + count, true);
+		if (used == i + count) {
+			bitmap_mark(region, i, i + count);
+			region->free -= size;
+			region->largest_free = region->free;
+			*ret = region->base + i * BASE_PAGE_SIZE;
+			return ERR_OK;
+		}
+		i = used + 1;
+	}
+	return ERR_PMM_OUT_OF_MEMORY;
+}
+
+size_t pmm_bitmap_alloc_batch(struct pmmRegion *region, paddr_t *frames, size_t count)
+{
+	struct pmmBitmap *bitmap = &region->bitmap;
+	size_t allocated = 0;
+	size_t words = ALIGN_UP(bitmap->frame_count, 64) / 64;
+
+	// Single frames are independent allocations, so free bits can be taken a whole word at a time
+	for (size_t w = BITMAP_WORD(bitmap->hint); w < words && allocated < count; w++) {
+		u64 free = ~bitmap->used[w];
+		u64 taken = 0;
+		while (free != 0 && allocated < count) {
+			u64 bit = free & -free;
+			free &= free - 1;
+			taken |= bit;
+			frames[allocated++] = region->base + (w * 64 + bit_ctz(bit)) * BASE_PAGE_SIZE;
+		}
+		bitmap->used[w] |= taken;
+		bitmap->ends[w] |= taken;
+	}
+	if (allocated > 0) {
+		size_t last = (frames[allocated - 1] - region->base) / BASE_PAGE_SIZE;
+		bitmap->hint = bitmap_find(bitmap->used, last, bitmap->frame_count, false);
+	}
+	region->free -= allocated * BASE_PAGE_SIZE;
+	region->largest_free = region->free;
+	return allocated;
+}
+
+size_t pmm_bitmap_block_size(struct pmmRegion *region, paddr_t base)
+{
+	struct pmmBitmap *bitmap = &region->bitmap;
+	size_t i = (base - region->base) / BASE_PAGE_SIZE;
+	if ((base & (BASE_PAGE_SIZE - 1)) != 0 || !BITMAP_TEST(bitmap->used, i) || BITMAP_TEST(bitmap->reserved, i)) {
+		return 0;
+	}
+	// The frame before an allocation is free, reserved or ends another allocation
+	if (i > 0 && BITMAP_TEST(bitmap->used, i - 1) && !BITMAP_TEST(bitmap->ends, i - 1) &&
+	    !BITMAP_TEST(bitmap->reserved, i - 1)) {
+		return 0;
+	}
+	size_t last = bitmap_find(bitmap->ends, i, bitmap->frame_count, true);
+	ASSERT(last < bitmap->frame_count, "[pmm_bitmap_block_size] Allocation at %x has no end marker.\n", base);
+	return (last - i + 1) * BASE_PAGE_SIZE;
+}
+
+errval_t pmm_bitmap_free(struct pmmRegion *region, paddr_t base, size_t *freed)
+{
+	struct pmmBitmap *bitmap = &region->bitmap;
+	size_t size = pmm_bitmap_block_size(region, base);
+	if (size == 0) {
+		return ERR_PMM_INVALID_FREE;
+	}
+	size_t i = (base - region->base) / BASE_PAGE_SIZE;
+	size_t end = i + size / BASE_PAGE_SIZE;
+
+	bitmap_fill(bitmap->used, i, end, false);
+	bitmap->ends[BITMAP_WORD(end - 1)] &= ~BITMAP_BIT(end - 1);
+	if (i < bitmap->hint) {
+		bitmap->hint = i;
+	}
+	region->free += size;
+	region->largest_free = region->free;
+	*freed = size;
+	return ERR_OK;
+}
+
+errval_t pmm_bitmap_reserve(struct pmmRegion *region, paddr_t base, size_t size)
+{
+	struct pmmBitmap *bitmap = &region->bitmap;
+	size_t from = (base - region->base) / BASE_PAGE_SIZE;
+	size_t to = from + size / BASE_PAGE_SIZE;
+	if (bitmap_find(bitmap->used, from, to, true) != to) {
+		return ERR_PMM_REGION_ALLOCATED_FROM;
+	}
+	bitmap_reserve(region, from, to);
+	region->free -= size;
+	region->largest_free = region->free;
+	return ERR_OK;
+}
+
+errval_t pmm_bitmap_release(struct pmmRegion *region, paddr_t base, size_t size)
+{
+	struct pmmBitmap *bitmap = &region->bitmap;
+	size_t from = (base - region->base) / BASE_PAGE_SIZE;
+	size_t to = from + size / BASE_PAGE_SIZE;
+
+	bitmap_fill(bitmap->used, from, to, false);
+	bitmap_fill(bitmap->reserved, from, to, false);
+	if (from < bitmap->hint) {
+		bitmap->hint = from;
+	}
+	region->free += size;
+	region->largest_free = region->free;
+	return ERR_OK;
+}
+
+errval_t pmm_bitmap_extend(struct pmmRegion *region, paddr_t base, size_t size, size_t *old_size)
+{
+	struct pmmBitmap *bitmap = &region->bitmap;
+	size_t old = pmm_bitmap_block_size(region, base);
+	if (old == 0) {
+		return ERR_PMM_INVALID_FREE;
+	}
+	*old_size = old;
+	if (size <= old) {
+		return ERR_OK;
+	}
+	size_t end = (base - region->base + old) / BASE_PAGE_SIZE;
+	size_t new_end = (base - region->base + size) / BASE_PAGE_SIZE;
+	if (new_end > bitmap->frame_count || bitmap_find(bitmap->used, end, new_end, true) != new_end) {
+		return ERR_PMM_CANNOT_EXTEND;
+	}
+
+	// Move the end marker past the newly taken frames
+	bitmap->ends[BITMAP_WORD(end - 1)] &= ~BITMAP_BIT(end - 1);
+	bitmap_mark(region, end, new_end);
+	region->free -= size - old;
+	region->largest_free = region->free;
+	return ERR_OK;
+}
@@ -0,0 +1,293 @@
+// Power-of-two buddy allocator backend for the physical memory manager.
+//
+// Every region keeps one free list per order, blocks of order n are 2^n frames long and aligned to their size in
+// physical memory, so an aligned request is simply a request for a large enough order. The frame state bytes live
+// in the first pages of the region and record, for every block head, its order and whether it is free.
+#include <octiron/pmm_internal.h>
+
+#include <kzadhbat/assert.h>
+#include <kzadhbat/bitmacros.h>
+#include <kzadhbat/libc/string.h>
+
+#define BUDDY_FRAME(region, pfn) ((region)->buddy.frames[(pfn) - PMM_PFN((region)->base)])
+#define BUDDY_BLOCK(pfn) ((struct pmmBuddyBlock *)PMM_PFN_ADDR(pfn))
+
+/// Returns the smallest order whose block holds at least frames frames.
+size_t buddy_order_for(size_t frames)
+{
+	if (frames <= 1) {
+		return 0;
+	}
+	return bit_fls(frames - 1);
+}
+
+void buddy_push(struct pmmRegion *region, u64 pfn, size_t order)
+{
+	struct pmmBuddyBlock *block = BUDDY_BLOCK(pfn);
+	block->prev = NULL;
+	block->next = region->buddy.free_lists[order];
+	if (block->next != NULL) {
+		block->next->prev = block;
+	}
+	region->buddy.free_lists[order] = block;
+	BUDDY_FRAME(region, pfn) = PMM_BUDDY_FREE | order;
+}
+
+void buddy_unlink(struct pmmRegion *region, u64 pfn, size_t order)
+{
+	struct pmmBuddyBlock *block = BUDDY_BLOCK(pfn);
+	if (block->prev != NULL) {
+		block->prev->next = block->next;
+	} else {
+		region->buddy.free_lists[order] = block->next;
+	}
+	if (block->next != NULL) {
+		block->next->prev = block->prev;
+	}
+	BUDDY_FRAME(region, pfn) = 0;
+}
+
+/// Caches the size of the largest free block, the highest order with a non-empty free list.
+void buddy_update_largest(struct pmmRegion *region)
+{
+	region->largest_free = 0;
+	for (size_t o = PMM_BUDDY_ORDER_COUNT; o-- > 0;) {
+		if (region->buddy.free_lists[o] != NULL) {
+			region->largest_free = PMM_PFN_ADDR((u64)1 << o);
+			break;
+		}
+	}
+}
+
+/// Frees the frames [start, end) by splitting them into the largest naturally aligned blocks that fit.
+void buddy_push_range(struct pmmRegion *region, u64 start, u64 end)
+{
+	while (start < end) {
+		size_t order = start ? bit_ctz(start) : PMM_BUDDY_MAX_ORDER;
+		if (order > PMM_BUDDY_MAX_ORDER) {
+			order = PMM_BUDDY_MAX_ORDER;
+		}
+		while (start + ((u64)1 << order) > end) {
+			order--;
+		}
+		buddy_push(region, start, order);
+		start += (u64)1 << order;
+	}
+}
+
+/// Finds the free block containing pfn, returning false if the frame is allocated or reserved.
+bool buddy_find_free(struct pmmRegion *region, u64 pfn, u64 *head, size_t *order)
+{
+	u64 first = PMM_PFN(region->base);
+	for (size_t o = 0; o <= PMM_BUDDY_MAX_ORDER; o++) {
+		u64 candidate = ALIGN_DOWN(pfn, (u64)1 << o);
+		if (candidate < first) {
+			break;
+		}
+		if (BUDDY_FRAME(region, candidate) == (PMM_BUDDY_FREE | o)) {
+			*head = candidate;
+			*order = o;
+			return true;
+		}
+	}
+	return false;
+}
+
+errval_t pmm_buddy_region_init(struct pmmRegion *region)
+{
+	u64 first = PMM_PFN(region->base);
+	u64 end = PMM_PFN(region->base + region->size);
+	size_t frame_count = end - first;
+
+	// The frame state bytes are carved out of the front of the region itself
+	size_t metadata = ALIGN_UP(frame_count, BASE_PAGE_SIZE);
+	if (metadata >= region->size) {
+		return ERR_PMM_ADD_REGION_TOO_SMALL;
+	}
+	region->buddy.frames = (u8 *)region->base;
+	memset(region->buddy.frames, 0, frame_count);
+	for (size_t o = 0; o < PMM_BUDDY_ORDER_COUNT; o++) {
+		region->buddy.free_lists[o] = NULL;
+	}
+	for (u64 pfn = first; pfn < first + PMM_PFN(metadata); pfn++) {
+		BUDDY_FRAME(region, pfn) = PMM_BUDDY_RESERVED;
+	}
+
+	buddy_push_range(region, first + PMM_PFN(metadata), end);
+	region->metadata = metadata;
+	region->free = region->size - metadata;
+	buddy_update_largest(region);
+	return ERR_OK;
+}
+
+errval_t pmm_buddy_alloc(struct pmmRegion *region, size_t size, size_t alignment, paddr_t *ret, size_t *allocated)
+{
+	size_t order = buddy_order_for(size / BASE_PAGE_SIZE);
+	size_t align_order = buddy_order_for(alignment / BASE_PAGE_SIZE);
+	if (align_order > order) {
+		order = align_order;
+	}
+	if (order > PMM_BUDDY_MAX_ORDER) {
+		return ERR_PMM_OUT_OF_MEMORY;
+	}
+
+	// Take the smallest free block that is at least as large as the request
+	size_t o = order;
+	while (o <= PMM_BUDDY_MAX_ORDER && region->buddy.free_lists[o] == NULL) {
+		o++;
+	}
+	if (o > PMM_BUDDY_MAX_ORDER) {
+		return ERR_PMM_OUT_OF_MEMORY;
+	}
+	u64 pfn = PMM_PFN(region->buddy.free_lists[o]);
+	buddy_unlink(region, pfn, o);
+
+	// Split it down, handing the upper halves back to the free lists
+	while (o > order) {
+		o--;
+		buddy_push(region, pfn + ((u64)1 << o), o);
+	}
+
+	BUDDY_FRAME(region, pfn) = PMM_BUDDY_HEAD | order;
+	*allocated = PMM_PFN_ADDR((u64)1 << order);
+	region->free -= *allocated;
+	buddy_update_largest(region);
+	*ret = PMM_PFN_ADDR(pfn);
+	return ERR_OK;
+}
+
+size_t pmm_buddy_alloc_batch(struct pmmRegion *region, paddr_t *frames, size_t count)
+{
+	size_t allocated = 0;
+	while (allocated < count) {
+		// Take the smallest free block and hand out its frames one by one
+		size_t o = 0;
+		while (o <= PMM_BUDDY_MAX_ORDER && region->buddy.free_lists[o] == NULL) {
+			o++;
+		}
+		if (o > PMM_BUDDY_MAX_ORDER) {
+			break;
+		}
+		u64 pfn = PMM_PFN(region->buddy.free_lists[o]);
+		u64 end = pfn + ((u64)1 << o);
+		buddy_unlink(region, pfn, o);
+		for (; pfn < end && allocated < count; pfn++) {
+			BUDDY_FRAME(region, pfn) = PMM_BUDDY_HEAD | 0;
+			frames[allocated++] = PMM_PFN_ADDR(pfn);
+		}
+		// Give back whatever the batch didn't need
+		buddy_push_range(region, pfn, end);
+	}
+	region->free -= PMM_PFN_ADDR(allocated);
+	buddy_update_largest(region);
+	return allocated;
+}
+
+size_t pmm_buddy_block_size(struct pmmRegion *region, paddr_t base)
+{
+	u8 state = BUDDY_FRAME(region, PMM_PFN(base));
+	if ((base & (BASE_PAGE_SIZE - 1)) != 0 || (state & PMM_BUDDY_HEAD) == 0) {
+		return 0;
+	}
+	return PMM_PFN_ADDR((u64)1 << (state & PMM_BUDDY_ORDER_MASK));
+}
+
+errval_t pmm_buddy_free(struct pmmRegion *region, paddr_t base, size_t *freed)
+{
+	u64 first = PMM_PFN(region->base);
+	u64 end = PMM_PFN(region->base + region->size);
+	u64 pfn = PMM_PFN(base);
+
+	u8 state = BUDDY_FRAME(region, pfn);
+	if ((base & (BASE_PAGE_SIZE - 1)) != 0 || (state & PMM_BUDDY_HEAD) == 0) {
+		return ERR_PMM_INVALID_FREE;
+	}
+	size_t order = state & PMM_BUDDY_ORDER_MASK;
+	*freed = PMM_PFN_ADDR((u64)1 << order);
+	region->free += *freed;
+
+	// Coalesce with the buddy for as long as it is free and of the same order
+	while (order < PMM_BUDDY_MAX_ORDER) {
+		u64 buddy = pfn ^ ((u64)1 << order);
+		if (buddy < first || buddy + ((u64)1 << order) > end) {
+			break;
+		}
+		if (BUDDY_FRAME(region, buddy) != (PMM_BUDDY_FREE | order)) {
+			break;
+		}
+		buddy_unlink(region, buddy, order);
+		BUDDY_FRAME(region, pfn) = 0;
+		pfn = pfn < buddy ? pfn : buddy;
+		order++;
+	}
+
+	buddy_push(region, pfn, order);
+	buddy_update_largest(region);
+	return ERR_OK;
+}
+
+errval_t pmm_buddy_reserve(struct pmmRegion *region, paddr_t base, size_t size)
+{
+	u64 start = PMM_PFN(base);
+	u64 end = PMM_PFN(base + size);
+
+	// Check that the whole range is free before touching any of the free lists
+	for (u64 pfn = start; pfn < end;) {
+		u64 head;
+		size_t order;
+		if (!buddy_find_free(region, pfn, &head, &order)) {
+			return ERR_PMM_REGION_ALLOCATED_FROM;
+		}
+		pfn = head + ((u64)1 << order);
+	}
+
+	// Pull every block overlapping the range and give back the parts sticking out of it
+	for (u64 pfn = start; pfn < end;) {
+		u64 head;
+		size_t order;
+		bool found = buddy_find_free(region, pfn, &head, &order);
+		ASSERT(found, "[pmm_buddy_reserve] Frame %x vanished from the free lists.\n", PMM_PFN_ADDR(pfn));
+		u64 block_end = head + ((u64)1 << order);
+		buddy_unlink(region, head, order);
+		buddy_push_range(region, head, start > head ? start : head);
+		buddy_push_range(region, end < block_end ? end : block_end, block_end);
+		pfn = block_end;
+	}
+	for (u64 pfn = start; pfn < end; pfn++) {
+		BUDDY_FRAME(region, pfn) = PMM_BUDDY_RESERVED;
+	}
+
+	region->free -= size;
+	buddy_update_largest(region);
+	return ERR_OK;
+}
+
+errval_t pmm_buddy_release(struct pmmRegion *region, paddr_t base, size_t size)
+{
+	u64 start = PMM_PFN(base);
+	u64 end = PMM_PFN(base + size);
+	for (u64 pfn = start; pfn < end; pfn++) {
+		if (BUDDY_FRAME(region, pfn) != PMM_BUDDY_RESERVED) {
+			return ERR_PMM_INVALID_FREE;
+		}
+	}
+	for (u64 pfn = start; pfn < end; pfn++) {
+		BUDDY_FRAME(region, pfn) = 0;
+	}
+
+	// Free the range as the largest naturally aligned blocks that fit, so they coalesce with their buddies
+	while (start < end) {
+		size_t order = start ? bit_ctz(start) : PMM_BUDDY_MAX_ORDER;
+		if (order > PMM_BUDDY_MAX_ORDER) {
+			order = PMM_BUDDY_MAX_ORDER;
+		}
+		while (start + ((u64)1 << order) > end) {
+			order--;
+		}
+		size_t freed;
+		BUDDY_FRAME(region, start) = PMM_BUDDY_HEAD | order;
+		pmm_buddy_free(region, PMM_PFN_ADDR(start), &freed);
+		start += (u64)1 << order;
+	}
+	return ERR_OK;
+}
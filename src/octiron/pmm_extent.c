@@ -0,0 +1,486 @@
+// Free extent backend for the physical memory manager, used by the first, best and worst fit policies.
+//
+// Free memory is kept as pmmBlock extents on an address ordered list, which first fit walks and frees coalesce
+// against. The same extents are indexed by (size, base) in a treap, so best and worst fit lookups are logarithmic,
+// and every allocation is recorded in a second treap keyed by base so pmm_free can recover its size.
+#include <octiron/pmm_internal.h>
+
+#include <kzadhbat/assert.h>
+#include <kzadhbat/bitmacros.h>
+
+/// Orders blocks by (size, base) in the size index and by base in the allocation index.
+int extent_cmp(const struct pmmBlock *a, const struct pmmBlock *b, bool by_size)
+{
+	if (by_size && a->size != b->size) {
+		return a->size < b->size ? -1 : 1;
+	}
+	if (a->base != b->base) {
+		return a->base < b->base ? -1 : 1;
+	}
+	return 0;
+}
+
+/// Treap priorities are derived from the block's base, which is unique within a tree.
+u64 extent_priority(const struct pmmBlock *block)
+{
+	return (block->base / BASE_PAGE_SIZE) * 0x9E3779B97F4A7C15ULL;
+}
+
+/// Splits the tree into the nodes ordered before key and those ordered after it.
+void treap_split(struct pmmBlock *root, const struct pmmBlock *key, bool by_size, struct pmmBlock **left,
+		 struct pmmBlock **right)
+{
+	if (root == NULL) {
+		*left = *right = NULL;
+	} else if (extent_cmp(root, key, by_size) < 0) {
+		treap_split(root->right, key, by_size, &root->right, right);
+		*left = root;
+	} else {
+		treap_split(root->left, key, by_size, left, &root->left);
+		*right = root;
+	}
+}
+
+/// Joins two trees, every node of left must be ordered before every node of right.
+struct pmmBlock *treap_merge(struct pmmBlock *left, struct pmmBlock *right)
+{
+	if (left == NULL) {
+		return right;
+	}
+	if (right == NULL) {
+		return left;
+	}
+	if (extent_priority(left) > extent_priority(right)) {
+		left->right = treap_merge(left->right, right);
+		return left;
+	}
+	right->left = treap_merge(left, right->left);
+	return right;
+}
+
+struct pmmBlock *treap_insert(struct pmmBlock *root, struct pmmBlock *node, bool by_size)
+{
+	if (root == NULL || extent_priority(node) > extent_priority(root)) {
+		treap_split(root, node, by_size, &node->left, &node->right);
+		return node;
+	}
+	if (extent_cmp(node, root, by_size) < 0) {
+		root->left = treap_insert(root->left, node, by_size);
+	} else {
+		root->right = treap_insert(root->right, node, by_size);
+	}
+	return root;
+}
+
+struct pmmBlock *treap_remove(struct pmmBlock *root, struct pmmBlock *node, bool by_size)
+{
+	ASSERT(root != NULL, "[treap_remove] Block %x is not in the tree.\n", node->base);
+	if (root == node) {
+		return treap_merge(root->left, root->right);
+	}
+	if (extent_cmp(node, root, by_size) < 0) {
+		root->left = treap_remove(root->left, node, by_size);
+	} else {
+		root->right = treap_remove(root->right, node, by_size);
+	}
+	return root;
+}
+
+/// Returns the first node ordered after key (or equal to it, unless strict).
+struct pmmBlock *treap_ceil(struct pmmBlock *root, const struct pmmBlock *key, bool by_size, bool strict)
+{
+	struct pmmBlock *best = NULL;
+	while (root != NULL) {
+		int cmp = extent_cmp(root, key, by_size);
+		if (cmp > 0 || (cmp == 0 && !strict)) {
+			best = root;
+			root = root->left;
+		} else {
+			root = root->right;
+		}
+	}
+	return best;
+}
+
+/// Returns the last node ordered before key.
+struct pmmBlock *treap_floor_strict(struct pmmBlock *root, const struct pmmBlock *key, bool by_size)
+{
+	struct pmmBlock *best = NULL;
+	while (root != NULL) {
+		if (extent_cmp(root, key, by_size) < 0) {
+			best = root;
+			root = root->right;
+		} else {
+			root = root->left;
+		}
+	}
+	return best;
+}
+
+struct pmmBlock *treap_max(struct pmmBlock *root)
+{
+	while (root != NULL && root->right != NULL) {
+		root = root->right;
+	}
+	return root;
+}
+
+void extent_index(struct pmmRegion *region, struct pmmBlock *block)
+{
+	block->left = block->right = NULL;
+	region->size_tree = treap_insert(region->size_tree, block, true);
+}
+
+void extent_unindex(struct pmmRegion *region, struct pmmBlock *block)
+{
+	region->size_tree = treap_remove(region->size_tree, block, true);
+}
+
+void extent_update_largest(struct pmmRegion *region)
+{
+	struct pmmBlock *largest = treap_max(region->size_tree);
+	region->largest_free = largest != NULL ? largest->size : 0;
+}
+
+/// Links block into the address ordered free list right after prev (at the head if prev is NULL).
+void extent_link(struct pmmRegion *region, struct pmmBlock *prev, struct pmmBlock *block)
+{
+	block->prev = prev;
+	block->next = prev != NULL ? prev->next : region->free_blocks;
+	if (block->next != NULL) {
+		block->next->prev = block;
+	}
+	if (prev != NULL) {
+		prev->next = block;
+	} else {
+		region->free_blocks = block;
+	}
+}
+
+void extent_unlink(struct pmmRegion *region, struct pmmBlock *block)
+{
+	if (block->prev != NULL) {
+		block->prev->next = block->next;
+	} else {
+		region->free_blocks = block->next;
+	}
+	if (block->next != NULL) {
+		block->next->prev = block->prev;
+	}
+}
+
+/// Removes [base, base + size) from the free block containing it. Splitting the block in two takes the spare block,
+/// which is set to NULL once it is used.
+void extent_carve(struct pmmRegion *region, struct pmmBlock *block, paddr_t base, size_t size, struct pmmBlock **spare)
+{
+	paddr_t block_end = block->base + block->size;
+
+	// Check if the current pmmBlock has atleast a page preceeding or postceeding
+	bool EXISTS_PRECEEDING = block->base != base;
+	bool EXISTS_POSTCEEDING = block_end > base + size;
+	extent_unindex(region, block);
+	if (EXISTS_PRECEEDING && EXISTS_POSTCEEDING) {
+		// Need to make a new block
+		struct pmmBlock *extra = *spare;
+		*spare = NULL;
+		block->size = base - block->base;
+		extra->base = base + size;
+		extra->size = block_end - (base + size);
+		extent_link(region, block, extra);
+		extent_index(region, block);
+		extent_index(region, extra);
+	} else if (EXISTS_PRECEEDING) {
+		block->size = base - block->base;
+		extent_index(region, block);
+	} else if (EXISTS_POSTCEEDING) {
+		block->base = base + size;
+		block->size = block_end - (base + size);
+		extent_index(region, block);
+	} else {
+		extent_unlink(region, block);
+		slab_free(&pmm.block_allocator, block);
+	}
+
+	region->free -= size;
+	extent_update_largest(region);
+}
+
+/// Returns the blocks taken ahead of an operation that ended up unused.
+void extent_release_spares(struct pmmBlock *record, struct pmmBlock *spare)
+{
+	if (record != NULL) {
+		slab_free(&pmm.block_allocator, record);
+	}
+	if (spare != NULL) {
+		slab_free(&pmm.block_allocator, spare);
+	}
+}
+
+/// Returns true if an aligned run of size bytes fits in block, storing its base in aligned_base.
+bool extent_fits(struct pmmBlock *block, size_t size, size_t alignment, paddr_t *aligned_base)
+{
+	*aligned_base = ALIGN_UP(block->base, alignment);
+	return block->base + block->size >= *aligned_base + size;
+}
+
+/// Picks the free block to allocate from according to the policy.
+struct pmmBlock *extent_select(struct pmmRegion *region, size_t size, size_t alignment, enum pmmPolicy policy,
+			       paddr_t *aligned_base)
+{
+	struct pmmBlock *block = NULL;
+	switch (policy) {
+	case PMM_POLICY_FIRST_FIT:
+		block = region->free_blocks;
+		while (block != NULL && !extent_fits(block, size, alignment, aligned_base)) {
+			block = block->next;
+		}
+		break;
+	case PMM_POLICY_BEST_FIT: {
+		// The smallest block of at least size bytes, moving up when the alignment doesn't fit
+		struct pmmBlock key = { .base = 0, .size = size };
+		block = treap_ceil(region->size_tree, &key, true, false);
+		while (block != NULL && !extent_fits(block, size, alignment, aligned_base)) {
+			block = treap_ceil(region->size_tree, block, true, true);
+		}
+		break;
+	}
+	case PMM_POLICY_WORST_FIT:
+		// The largest block, moving down when the alignment doesn't fit
+		block = treap_max(region->size_tree);
+		while (block != NULL && block->size >= size && !extent_fits(block, size, alignment, aligned_base)) {
+			block = treap_floor_strict(region->size_tree, block, true);
+		}
+		if (block != NULL && block->size < size) {
+			block = NULL;
+		}
+		break;
+	default:
+		ASSERT(false, "[extent_select] Policy %d does not use the extent backend.\n", (size_t)policy);
+	}
+	return block;
+}
+
+errval_t pmm_extent_region_init(struct pmmRegion *region)
+{
+	struct pmmBlock *free_block = (struct pmmBlock *)slab_alloc(&pmm.block_allocator);
+	if (free_block == NULL) {
+		return ERR_PMM_SLAB_ALLOC_FAILED;
+	}
+	free_block->base = region->base;
+	free_block->size = region->size;
+	region->free_blocks = NULL;
+	region->size_tree = NULL;
+	region->alloc_tree = NULL;
+	extent_link(region, NULL, free_block);
+	extent_index(region, free_block);
+	extent_update_largest(region);
+	return ERR_OK;
+}
+
+void pmm_extent_region_release(struct pmmRegion *region)
+{
+	ASSERT(region->alloc_tree == NULL, "[pmm_extent_region_release] Region %x still has allocations.\n",
+	       region->base);
+	while (region->free_blocks != NULL) {
+		struct pmmBlock *block = region->free_blocks;
+		region->free_blocks = block->next;
+		slab_free(&pmm.block_allocator, block);
+	}
+	region->size_tree = NULL;
+}
+
+errval_t pmm_extent_alloc(struct pmmRegion *region, size_t size, size_t alignment, enum pmmPolicy policy,
+			  paddr_t *ret)
+{
+	// Take the blocks for the allocation record and a possible split first, a slab refill allocates from the pmm
+	// and must not find the free extents half updated
+	struct pmmBlock *record = slab_alloc(&pmm.block_allocator);
+	struct pmmBlock *spare = slab_alloc(&pmm.block_allocator);
+	if (record == NULL || spare == NULL) {
+		extent_release_spares(record, spare);
+		return ERR_PMM_SLAB_ALLOC_FAILED;
+	}
+
+	paddr_t aligned_base = 0;
+	struct pmmBlock *block = extent_select(region, size, alignment, policy, &aligned_base);
+	if (block == NULL) {
+		extent_release_spares(record, spare);
+		return ERR_PMM_OUT_OF_MEMORY;
+	}
+	extent_carve(region, block, aligned_base, size, &spare);
+	extent_release_spares(NULL, spare);
+
+	// Record the allocation so it can be freed without the caller knowing its size
+	record->base = aligned_base;
+	record->size = size;
+	record->left = record->right = NULL;
+	region->alloc_tree = treap_insert(region->alloc_tree, record, false);
+
+	*ret = aligned_base;
+	return ERR_OK;
+}
+
+size_t pmm_extent_alloc_batch(struct pmmRegion *region, paddr_t *frames, size_t count)
+{
+	size_t allocated = 0;
+	while (allocated < count && region->free_blocks != NULL) {
+		// Take the records for a run of frames first, for the same reason as pmm_extent_alloc
+		struct pmmBlock *records[PMM_EXTENT_BATCH_RUN];
+		size_t run = 0;
+		while (run < PMM_EXTENT_BATCH_RUN && run < count - allocated) {
+			if ((records[run] = slab_alloc(&pmm.block_allocator)) == NULL) {
+				break;
+			}
+			run++;
+		}
+		// Refilling the block slab may have taken the last free extent
+		struct pmmBlock *block = region->free_blocks;
+		if (run == 0 || block == NULL) {
+			for (size_t i = 0; i < run; i++) {
+				slab_free(&pmm.block_allocator, records[i]);
+			}
+			break;
+		}
+
+		// Carve the run from the front of the lowest free extent, which never splits it
+		size_t frames_in_block = block->size / BASE_PAGE_SIZE;
+		size_t taken = run < frames_in_block ? run : frames_in_block;
+		paddr_t base = block->base;
+		extent_carve(region, block, base, taken * BASE_PAGE_SIZE, NULL);
+		for (size_t i = 0; i < run; i++) {
+			if (i >= taken) {
+				slab_free(&pmm.block_allocator, records[i]);
+				continue;
+			}
+			records[i]->base = base + i * BASE_PAGE_SIZE;
+			records[i]->size = BASE_PAGE_SIZE;
+			records[i]->left = records[i]->right = NULL;
+			region->alloc_tree = treap_insert(region->alloc_tree, records[i], false);
+			frames[allocated++] = records[i]->base;
+		}
+	}
+	return allocated;
+}
+
+size_t pmm_extent_block_size(struct pmmRegion *region, paddr_t base)
+{
+	struct pmmBlock key = { .base = base };
+	struct pmmBlock *record = treap_ceil(region->alloc_tree, &key, false, false);
+	return (record != NULL && record->base == base) ? record->size : 0;
+}
+
+/// Puts block back on the free list and into the size index, coalescing it with its free neighbours.
+void extent_insert_free(struct pmmRegion *region, struct pmmBlock *block)
+{
+	region->free += block->size;
+
+	// Find the free neighbours of the block on the address ordered list
+	struct pmmBlock *prev = NULL;
+	struct pmmBlock *next = region->free_blocks;
+	while (next != NULL && next->base < block->base) {
+		prev = next;
+		next = next->next;
+	}
+
+	// Coalesce with the preceeding block, linking in the block itself otherwise
+	if (prev != NULL && prev->base + prev->size == block->base) {
+		extent_unindex(region, prev);
+		prev->size += block->size;
+		slab_free(&pmm.block_allocator, block);
+		block = prev;
+	} else {
+		extent_link(region, prev, block);
+	}
+	// Coalesce with the postceeding block
+	if (next != NULL && block->base + block->size == next->base) {
+		extent_unindex(region, next);
+		extent_unlink(region, next);
+		block->size += next->size;
+		slab_free(&pmm.block_allocator, next);
+	}
+	extent_index(region, block);
+	extent_update_largest(region);
+}
+
+errval_t pmm_extent_free(struct pmmRegion *region, paddr_t base, size_t *freed)
+{
+	struct pmmBlock key = { .base = base };
+	struct pmmBlock *block = treap_ceil(region->alloc_tree, &key, false, false);
+	if (block == NULL || block->base != base) {
+		return ERR_PMM_INVALID_FREE;
+	}
+	region->alloc_tree = treap_remove(region->alloc_tree, block, false);
+	*freed = block->size;
+
+	// The allocation record becomes the free block
+	extent_insert_free(region, block);
+	return ERR_OK;
+}
+
+errval_t pmm_extent_release(struct pmmRegion *region, paddr_t base, size_t size)
+{
+	struct pmmBlock *block = slab_alloc(&pmm.block_allocator);
+	if (block == NULL) {
+		return ERR_PMM_SLAB_ALLOC_FAILED;
+	}
+	block->base = base;
+	block->size = size;
+	extent_insert_free(region, block);
+	return ERR_OK;
+}
+
+errval_t pmm_extent_reserve(struct pmmRegion *region, paddr_t base, size_t size)
+{
+	struct pmmBlock *spare = slab_alloc(&pmm.block_allocator);
+	if (spare == NULL) {
+		return ERR_PMM_SLAB_ALLOC_FAILED;
+	}
+
+	// Search in the free blocks of the region for the block to remove
+	errval_t err = ERR_PMM_REGION_ALLOCATED_FROM;
+	for (struct pmmBlock *block = region->free_blocks; block != NULL; block = block->next) {
+		bool UNDER_BOUND = base >= block->base;
+		bool UP_BOUND = base + size <= block->base + block->size;
+		if (UNDER_BOUND && UP_BOUND) {
+			extent_carve(region, block, base, size, &spare);
+			err = ERR_OK;
+			break;
+		} else if (UP_BOUND) {
+			// We've gone past the block we are looking for, so we can stop searching
+			break;
+		}
+	}
+	extent_release_spares(NULL, spare);
+	return err;
+}
+
+errval_t pmm_extent_extend(struct pmmRegion *region, paddr_t base, size_t size, size_t *old_size)
+{
+	struct pmmBlock key = { .base = base };
+	struct pmmBlock *record = treap_ceil(region->alloc_tree, &key, false, false);
+	if (record == NULL || record->base != base) {
+		return ERR_PMM_INVALID_FREE;
+	}
+	*old_size = record->size;
+	if (size <= record->size) {
+		return ERR_OK;
+	}
+	paddr_t end = record->base + record->size;
+	size_t extra = size - record->size;
+
+	// The free extent has to start right where the allocation ends
+	struct pmmBlock *block = region->free_blocks;
+	while (block != NULL && block->base < end) {
+		block = block->next;
+	}
+	if (block == NULL || block->base != end || block->size < extra) {
+		return ERR_PMM_CANNOT_EXTEND;
+	}
+	// Carving from the front of a block never splits it, so no spare is needed
+	struct pmmBlock *spare = NULL;
+	extent_carve(region, block, end, extra, &spare);
+
+	// The allocation index is ordered by base, which does not change
+	record->size = size;
+	return ERR_OK;
+}
@@ -0,0 +1,113 @@
+// Frame database of the physical memory manager.
+//
+// Every region carries one pmmFrame descriptor per frame, stored in the region itself right after the backend's
+// metadata and indexed by the frame's offset into the region. The descriptors follow the allocations the pmm hands
+// out, and hold what the backends don't know about: the owner of a frame, its references and its mappings.
+#include <octiron/pmm_internal.h>
+
+#include <kzadhbat/assert.h>
+#include <kzadhbat/bitmacros.h>
+#include <kzadhbat/libc/string.h>
+
+#define FRAME_OF(region, addr) (&(region)->frames[PMM_PFN(addr) - PMM_PFN((region)->base)])
+
+errval_t pmm_frames_region_init(struct pmmRegion *region)
+{
+	size_t count = region->size / BASE_PAGE_SIZE;
+	size_t size = ALIGN_UP(count * sizeof(struct pmmFrame), BASE_PAGE_SIZE);
+	if (region->metadata + size >= region->size) {
+		return ERR_PMM_ADD_REGION_TOO_SMALL;
+	}
+	paddr_t base = region->base + region->metadata;
+	errval_t err = pmm_backend_reserve(region, base, size);
+	if (err_is_fail(err)) {
+		return err;
+	}
+	region->frames = (struct pmmFrame *)base;
+	region->metadata += size;
+	pmm.frame_db += size;
+
+	// Free frames have all-zero descriptors, only the metadata frames need marking
+	memset(region->frames, 0, count * sizeof(struct pmmFrame));
+	pmm_frames_mark(region, region->base, region->metadata, PMM_FRAME_RESERVED);
+	return ERR_OK;
+}
+
+void pmm_frames_mark(struct pmmRegion *region, paddr_t base, size_t size, enum pmmFrameType type)
+{
+	struct pmmFrame *frame = FRAME_OF(region, base);
+	struct pmmFrame *end = frame + size / BASE_PAGE_SIZE;
+	for (; frame < end; frame++) {
+		*frame = (struct pmmFrame){ .type = type };
+	}
+}
+
+void pmm_frames_claim(struct pmmRegion *region, paddr_t base, size_t size, u32 flags)
+{
+	struct pmmFrame *frame = FRAME_OF(region, base);
+	struct pmmFrame *end = frame + size / BASE_PAGE_SIZE;
+	*frame = (struct pmmFrame){ .refcount = 1, .flags = flags | PMM_FRAME_HEAD, .type = PMM_FRAME_KERNEL };
+	while (++frame < end) {
+		*frame = (struct pmmFrame){ .flags = flags, .type = PMM_FRAME_KERNEL };
+	}
+}
+
+struct pmmFrame *pmm_frame(paddr_t addr)
+{
+	struct pmmRegion *region = pmm_find_region(addr);
+	if (region == NULL) {
+		return NULL;
+	}
+	return FRAME_OF(region, addr);
+}
+
+/// Returns the descriptor of the first frame of the allocation based at base, or NULL if base does not start one.
+struct pmmFrame *pmm_frame_head(u8 *base)
+{
+	struct pmmFrame *frame = pmm_frame((paddr_t)base);
+	if (frame == NULL || ((paddr_t)base & (BASE_PAGE_SIZE - 1)) != 0 || (frame->flags & PMM_FRAME_HEAD) == 0) {
+		return NULL;
+	}
+	return frame;
+}
+
+errval_t pmm_frame_set_type(u8 *base, enum pmmFrameType type, u16 owner)
+{
+	struct pmmFrame *frame = pmm_frame_head(base);
+	size_t size = pmm_block_size((paddr_t)base);
+	if (frame == NULL || size == 0) {
+		return ERR_PMM_INVALID_FREE;
+	}
+	for (struct pmmFrame *end = frame + size / BASE_PAGE_SIZE; frame < end; frame++) {
+		frame->type = type;
+		frame->owner = owner;
+	}
+	return ERR_OK;
+}
+
+errval_t pmm_frame_get(u8 *base)
+{
+	struct pmmFrame *frame = pmm_frame_head(base);
+	if (frame == NULL || frame->refcount == 0) {
+		return ERR_PMM_INVALID_FREE;
+	}
+	__atomic_fetch_add(&frame->refcount, 1, __ATOMIC_RELAXED);
+	return ERR_OK;
+}
+
+errval_t pmm_frame_put(u8 *base)
+{
+	struct pmmFrame *frame = pmm_frame_head(base);
+	if (frame == NULL || frame->refcount == 0) {
+		return ERR_PMM_INVALID_FREE;
+	}
+	if (__atomic_sub_fetch(&frame->refcount, 1, __ATOMIC_ACQ_REL) != 0) {
+		return ERR_OK;
+	}
+	return pmm_free(base);
+}
+
+size_t pmm_frame_db_mem(void)
+{
+	return pmm.frame_db;
+}
@@ -0,0 +1,64 @@
+#include <octiron/vector.h>
+#include <octiron/devices/device_tree/device_tree.h>
+
+#include <kzadhbat/arch/riscv.h>
+#include <kzadhbat/fmtprint.h>
+#include <kzadhbat/libc/string.h>
+
+/// Vector register length in bytes, 0 while the vector unit is off.
+size_t vector_vlenb = 0;
+
+/// Saves the registers of the hart into state, see vector.S.
+void vector_save_registers(struct vectorState *state);
+/// Loads the registers of the hart from state, see vector.S.
+void vector_restore_registers(struct vectorState *state);
+
+errval_t vector_initialize(void)
+{
+#ifdef ENABLE_RVV
+	if (!dt_cpu_has_extension("v")) {
+		println("[vector_initialize] The harts lack the V extension, using the scalar libc routines.");
+		return ERR_OK;
+	}
+	csrw_sstatus((csrr_sstatus() & ~SSTATUS_VS_MASK) | SSTATUS_VS_INITIAL);
+	// vlenb is only readable once the unit is on, the assembler only knows its name with V enabled
+	asm volatile("csrr %0, 0xc22" : "=r"(vector_vlenb));
+	libc_use_vector(true);
+	println("[vector_initialize] Vector unit on, %d bit registers, using the RVV libc routines.", vector_vlenb * 8);
+#endif
+	return ERR_OK;
+}
+
+bool vector_available(void)
+{
+	return vector_vlenb != 0;
+}
+
+size_t vector_state_size(void)
+{
+	return 32 * vector_vlenb;
+}
+
+void vector_save(struct vectorState *state)
+{
+	if (!vector_available()) {
+		return;
+	}
+	// Clean registers match the copy the state got on its last save or restore, only Dirty ones need storing.
+	// A state that was never saved holds no copy yet
+	if (state->saved && (csrr_sstatus() & SSTATUS_VS_MASK) != SSTATUS_VS_DIRTY) {
+		return;
+	}
+	vector_save_registers(state);
+	state->saved = true;
+	csrw_sstatus((csrr_sstatus() & ~SSTATUS_VS_MASK) | SSTATUS_VS_CLEAN);
+}
+
+void vector_restore(struct vectorState *state)
+{
+	if (!vector_available() || !state->saved) {
+		return;
+	}
+	vector_restore_registers(state);
+	csrw_sstatus((csrr_sstatus() & ~SSTATUS_VS_MASK) | SSTATUS_VS_CLEAN);
+}